@@ -90,6 +90,19 @@ matter if it is empty or occupied.  We could, in like manner, throw
 away the a file and reduce the dimension to 64 but that introduces 
 some extra math (which the cache savings may or may not pay for) into 
 the bit shift calculation.
+
+Magic bitboards (the default, see magic_bitboards in chess.h) do away 
+with the rotated boards.  Rather than keep the occupation state of 
+each rrank around in rotated form we gather it from the normal board 
+when we need it.  For each square we mask the occupied squares down to 
+those that can block the slider (the edge squares never block since 
+there is nothing behind them) and multiply by a magic number.  The 
+magic is chosen so the product carries all the mask bits, in some 
+scrambled order, in its top bits without two occupation states that 
+give different attacks landing on the same value.  Shifting the top 
+bits down gives an index into the attack board for the square.  One 
+multiply and one lookup gives all rook (or bishop) attacks at once 
+and make/unmake only has to update the normal board.
 *********************************************************************/
 
 //====================================================================
@@ -124,23 +137,138 @@ int Attacked(int b1, int ka) {
 }
 
 //====================================================================
-//Sex() Static exchange.  a true static exchange function would look
-//at all attackors and defenders, this just looks to see if the
-//prospective capture is defended
+//See() and SeeGE() perform a static exchange evaluation.  That is
+//they play out the captures on the target square of a move, least
+//valuable attacker first, without looking at anything else.  See()
+//returns the material won (negative if lost) and SeeGE() returns TRUE
+//if the material won is at least margin.  SeeGE() can quit as soon as
+//the answer is known so it's the better choice if that's all we need.
+//
+//The attackors come from Attacks().  As men are traded off the
+//square a bishop, rook or queen may be uncovered behind them (an 
+//x-ray attack).  XRay() finds these.  A king can only recapture if
+//the other side has no attackors left.  Pins are ignored.
+//====================================================================
+static const int see_king = 10000;  //king value for exchange
+
+static int SeeValue(int man) {
+  if ((man & TYPE) == KING) return see_king;
+  return piece_value[man];
+}
+
+//====================================================================
+//XRay() returns the bishop, rook or queen (if any) that attacks b2
+//through b1 once b1 is removed from occ.
+//====================================================================
+static U64 XRay(int b2, int b1, U64 occ) {
+  int d1 = directions[b2][b1];
+  U64 men;
+  if (!d1) return 0;
+  men = (abs_val(d1) == 1 || abs_val(d1) == 8) ? rook_queen : bish_queen;
+  //step away from b2 till we bump into something or run off the board
+  while ((b1 + d1 >= 0) && (b1 + d1 < 64) && (directions[b1][b1+d1] == d1)) {
+    b1 += d1;
+    if (occ & sq_set[b1]) return men & sq_set[b1];
+  }
+  return 0;
+}
+
+//====================================================================
+//LeastValuable() returns the least valuable man in men of color side
+//and its square b1.  men must not be empty.
 //====================================================================
-int Sex(int move) {
-  int win = piece_value[mv_cap(move)];    //prospective capture winnings
-  int lose = piece_value[mv_man(move)];   //what we stand to lose
-  if (mv_pro(move)) {                     //steaks go up if promotion
-    win += q_val - p_val;
-    lose = q_val;
+static int LeastValuable(U64 men, int side, int &b1) {
+  static const int order[6] = {PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING};
+  int i;
+  U64 a1;
+  for (i = 0; i < 5; i++) {
+    a1 = men & bbd[order[i] + side];
+    if (a1) break;
   }
-  if (Attacked(mv_b2(move), color ^ KTC))
-    return win - lose;                    //capture is defended
-  else
-    return win;                           //capture not defended
+  if (i == 5) a1 = men;
+  b1 = FirstBit(a1);
+  return order[i] + side;
 }
 
+//====================================================================
+//SeeStart() makes the move on occ and returns the attackors of the 
+//target square, the value of the capture and the value of the man 
+//left standing on the target.
+//====================================================================
+static U64 SeeStart(int move, U64 &occ, int &win, int &stake) {
+  int b1 = mv_b1(move), b2 = mv_b2(move), b3;
+  U64 attacks;
+  win = piece_value[mv_cap(move)];        //prospective capture winnings
+  stake = SeeValue(mv_man(move));         //what we stand to lose
+  if (mv_pro(move)) {                     //stakes go up if promotion
+    win += piece_value[mv_pro(move)] - p_val;
+    stake = piece_value[mv_pro(move)];
+  }
+  occ = occupied ^ sq_set[b1];
+  attacks = (Attacks(b2) & occ) | XRay(b2, b1, occ);
+  if (mv_spl(move) == 3) {                //ep - captured pawn not on b2
+    b3 = color ? b2 + 8 : b2 - 8;
+    occ ^= sq_set[b3];
+    attacks |= XRay(b2, b3, occ);
+  }
+  return attacks;
+}
+
+int See(int move) {
+  int b1, b2 = mv_b2(move), d = 0, man, side = color;
+  int gain[32];
+  U64 occ, attacks, men;
+
+  attacks = SeeStart(move, occ, gain[0], man);
+  for ( ; ; ) {
+    d++;
+    side ^= KTC;
+    gain[d] = man - gain[d-1];            //score if our man is taken
+    men = attacks & (side ? b_men : w_men);
+    if (!men) break;
+    man = LeastValuable(men, side, b1);
+    if (((man & TYPE) == KING) && (attacks & occ & ~men)) break;
+    occ ^= sq_set[b1];
+    attacks = (attacks & occ) | XRay(b2, b1, occ);
+    man = SeeValue(man);
+  }
+  //minimax back up the swap list
+  while (--d) {
+    if (-gain[d] < gain[d-1]) gain[d-1] = -gain[d];
+  }
+  return gain[0];
+}
+
+int SeeGE(int move, int margin) {
+  int b1, b2 = mv_b2(move), man, side = color, val, win, res = TRUE;
+  U64 occ, attacks, men;
+
+  attacks = SeeStart(move, occ, win, man);
+  val = win - margin;                     //what we win if not retaken
+  if (val < 0) return FALSE;
+  val = man - val;                        //what they win if they retake
+  if (val <= 0) return TRUE;
+  for ( ; ; ) {
+    side ^= KTC;
+    men = attacks & (side ? b_men : w_men);
+    if (!men) break;
+    man = LeastValuable(men, side, b1);
+    if ((man & TYPE) == KING) {
+      //king can take only if the other side has nothing left
+      if (attacks & occ & ~men) break;
+      res ^= 1;
+      break;
+    }
+    res ^= 1;
+    val = SeeValue(man) - val;
+    if (val < res) break;                 //side can stand pat
+    occ ^= sq_set[b1];
+    attacks = (attacks & occ) | XRay(b2, b1, occ);
+  }
+  return res;
+}
+
+#if !magic_bitboards
 //=====================================================================
 //GetAtk() gets attacks from file c1 on an rrank of length len with 
 //occupation state j1.  It simply goes left and right setting bits 
@@ -174,14 +302,77 @@ static int GetAtk(int c1, int j1, int len) {
   i1 = (1<<len) - 1;
   return (a1 & i1);
 }
+#endif  //if !magic_bitboards
+
+#if magic_bitboards
+//=====================================================================
+//SlideAtk() gets attacks from square b1 with occupation state occ.  It
+//steps along each of the 4 directions in dir[] until it bumps into
+//something or falls off the board.  directions[] must be initialized.
+//=====================================================================
+static U64 SlideAtk(int b1, U64 occ, const int *dir) {
+  int i, b2, d1;
+  U64 a1 = 0;
+  for (i = 0; i < 4; i++) {
+    d1 = dir[i];
+    b2 = b1;
+    //directions[][] is not d1 if the step wraps around the board
+    while ((b2 + d1 >= 0) && (b2 + d1 < 64) && (directions[b2][b2+d1] == d1)) {
+      b2 += d1;
+      a1 |= sq_set[b2];
+      if (occ & sq_set[b2]) break;
+    }
+  }
+  return a1;
+}
+
+//=====================================================================
+//InitMagic() fills the magic attack boards for one slider type.  The
+//boards for each square are carved from atk, the (zeroed) free space 
+//of ap_magic[], and a pointer to the remaining space is returned.
+//=====================================================================
+static U64 *InitMagic(s_magic *mg, const U64 *magic, const int *dir, U64 *atk) {
+  int b1, idx;
+  U64 occ, a1, edges;
+  for (b1 = 0; b1 < 64; b1++) {
+    //edge squares block nothing unless we are on that edge
+    edges = ((rank_1 | rank_8) & ~mask_row[row(b1)]) |
+            ((file_a | file_h) & ~mask_col[col(b1)]);
+    mg[b1].mask = SlideAtk(b1, 0, dir) & ~edges;
+    mg[b1].magic = magic[b1];
+    mg[b1].shift = 64 - BitCount(mg[b1].mask);
+    mg[b1].atk = atk;
+    atk += (U64) 1 << (64 - mg[b1].shift);
+    //visit every subset of the mask (carry rippler) and fill the board
+    occ = 0;
+    do {
+      a1 = SlideAtk(b1, occ, dir);
+#if use_pext
+      idx = (int) _pext_u64(occ, mg[b1].mask);
+#else
+      idx = (int) ((occ * mg[b1].magic) >> mg[b1].shift);
+#endif
+      assert(!mg[b1].atk[idx] || (mg[b1].atk[idx] == a1));  //bad magic
+      mg[b1].atk[idx] = a1;
+      occ = (occ - mg[b1].mask) & mg[b1].mask;
+    } while (occ);
+  }
+  return atk;
+}
+#endif  //if magic_bitboards
 
 //====================================================================
 //InitAttack() initialize directions[] and obstructed[] arrays and 
-//the rotated attack boards.
+//the magic or rotated attack boards.
 //====================================================================
 void InitAttack(void) {
-  int i, j, b1, r1, c1, d1, len;
+  int i, j, b1, r1, c1, d1;
   U64 a1, mask;
+#if magic_bitboards
+  static const int rook_dir[4] = {1, -1, 8, -8};
+  static const int bish_dir[4] = {7, -7, 9, -9};
+#else
+  int len;
   //rotated board geometry.
   char rl90[64] = {
     56, 48, 40, 32, 24, 16,  8, 0,
@@ -220,6 +411,7 @@ void InitAttack(void) {
     36, 36, 36, 43, 43, 43, 43, 43,
     43, 49, 49, 49, 49, 49, 54, 54,
     54, 54, 58, 58, 58, 61, 61, 63};
+#endif
   //initialize directions[] and obstructed[]
   for (i=0; i<64; i++) {
     a1 = ap_queen[i];
@@ -245,6 +437,20 @@ void InitAttack(void) {
       }
     }
   }
+#if magic_bitboards
+  //diagonal masks to split bishop attacks
+  for (i = 0; i < 64; i++) {
+    mask_rl45[i] = mask_rr45[i] = 0;
+    for (j = 0; j < 64; j++) {
+      if (abs_val(directions[i][j]) == 7) mask_rl45[i] |= sq_set[j];
+      if (abs_val(directions[i][j]) == 9) mask_rr45[i] |= sq_set[j];
+    }
+  }
+  //magic attack boards, rooks first then bishops
+  memset(ap_magic, 0, (102400 + 5248) * sizeof(U64));
+  InitMagic(mg_bish, magic_bish, bish_dir,
+    InitMagic(mg_rook, magic_rook, rook_dir, ap_magic));
+#else
   //initialize the rr00 (non rotated) attack board
   for (i = 0; i < 64; i++) {      //i = square on normal board
     for (j = 0; j < 128; j++) {   //j = state of occupation
@@ -303,5 +509,6 @@ void InitAttack(void) {
       }
     }
   }
+#endif  //if magic_bitboards
 } //InitAttack()
 
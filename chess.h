@@ -17,6 +17,13 @@ Main header file
 //You can email for the latest version if you wish to use it.
 //#define bruja_book 0
 
+//set magic_bitboards to 0 to compute sliding piece attacks from the
+//rotated bitboards rather than the magic multiplier tables.  the
+//rotated boards cost 3 extra board updates per piece moved.
+#ifndef magic_bitboards
+  #define magic_bitboards 1
+#endif
+
 
 #ifdef _MSC_VER
 #define inline __inline
@@ -52,7 +59,10 @@ static bool bruja_book    = false;
 #define MATE          31000             //mate in n reference
 #define DEAD          30000             //mate scores
 #define MAX_PLY       64                //max search depth
+#define PLY           4                 //depth units per ply
 #define MAX_HIX       200               //game history
+#define MAX_CORES     64                //max search threads
+#define MAX_MPV       16                //max multi-pv lines
 
 #define WHITE         0
 #define PAWN          1
@@ -167,12 +177,26 @@ typedef enum {
 #define atk_wpawn(sq)   (ap_wpawn[sq])
 #define atk_bpawn(sq)   (ap_bpawn[sq])
 #define atk_knight(sq)  (ap_knight[sq])
+#if magic_bitboards
+#if use_pext
+#define atk_magic(mg)   ((mg).atk[_pext_u64((occupied), (mg).mask)])
+#else
+#define atk_magic(mg)   ((mg).atk[(((occupied)&(mg).mask)*(mg).magic)>>(mg).shift])
+#endif
+#define atk_rook(sq)    atk_magic(mg_rook[sq])
+#define atk_bish(sq)    atk_magic(mg_bish[sq])
+#define atk_rank(sq)    (atk_rook(sq) & mask_row[row(sq)])
+#define atk_file(sq)    (atk_rook(sq) & mask_col[col(sq)])
+#define atk_rl45(sq)    (atk_bish(sq) & mask_rl45[sq])
+#define atk_rr45(sq)    (atk_bish(sq) & mask_rr45[sq])
+#else
 #define atk_rank(sq)    (ap_rook_rr00[sq][((occupied)>>((sq)&56))&127])
 #define atk_file(sq)    (ap_rook_rl90[sq][(bb_rl90>>(col(sq)<<3))&127])
 #define atk_rl45(sq)    (ap_bish_rl45[sq][(bb_rl45>>shr_bish_rl45[sq])&127])
 #define atk_rr45(sq)    (ap_bish_rr45[sq][(bb_rr45>>shr_bish_rr45[sq])&127])
 #define atk_rook(sq)    (atk_rank(sq)|atk_file(sq))
 #define atk_bish(sq)    (atk_rl45(sq)|atk_rr45(sq))
+#endif
 #define atk_queen(sq)   (atk_rook(sq)|atk_bish(sq))
 #define atk_king(sq)    (ap_king[sq])
 
@@ -200,8 +224,76 @@ typedef struct {
   int           killer1;      //killer moves
   int           killer2;
   U64           key1;         //hash key
+  int           null;         //TRUE while the null move is searched
+  int           move;         //move being searched
+  int           ext;          //extensions on the path, PLY units
+  int           skip;         //move skipped by singular search
 } s_tree;
 
+//check info for a node, see SetCheck()
+typedef struct {
+  U64           key;          //hash key of the position
+  U64           checkers;     //men giving check to the side to move
+  U64           pins;         //our men pinned to our king
+  U64           pin_mask[64]; //where each pinned man can go
+  U64           check_key;    //hash key when disc & check_sq were set
+  U64           disc;         //our men that uncover check if they move
+  U64           check_sq[8];  //by type, squares a man gives check from
+} s_check;
+
+//basic position, enough to rebuild everything else
+typedef struct {
+  int           board[64];    //array board
+  int           color;        //color moving
+  int           cast;         //castle rights
+  int           ep;           //en passant sq
+  int           gp;           //half move clock
+  int           hix;          //game history for draw detection
+  s_hist        hist[MAX_HIX+2];
+} s_pos;
+
+//transposition hash table, see hash.cpp.  every search context 
+//points to one so games searched at once don't trample each other's
+//entries or generations.  the xboard loop uses xb_hash.
+struct hash_bucket;
+typedef struct {
+  hash_bucket * table;        //buckets (aligned)
+  size_t        bytes;        //memory allocated
+  unsigned      nel;          //number of buckets
+  unsigned      epoch;        //bumped by ClearHash()
+  int           gen;          //search generation
+  int           keep;         //skip next ClearHash()
+  char        * map;          //mapped file, header first
+  char          map_name[512];  //name of mapped file
+} s_hash;
+
+//search context, one per game being searched and shared by the 
+//threads searching it.  the xboard loop uses xb_search.
+typedef struct {
+  s_hash      * hash;         //transposition table of this game
+  volatile int  abort;        //stop all threads of this search
+  int           start;        //start time, 1/1000's sec
+  int           target;       //target search time, 1/1000's sec
+  int           max_depth;    //depth limit
+  int           iter;         //current iteration
+  int           score;        //score of last complete iteration
+  int           cores;        //threads searching
+  int           multi_pv;     //best lines to report, see Iterate()
+  int           post;         //post pv lines
+  int           best_share;   //% of last iteration spent on best move
+  int           fail_lo;      //root fail lows (aspiration window)
+  int           fail_hi;      //root fail highs
+  volatile unsigned helper_nodes[MAX_CORES];  //nodes by helper
+} s_search;
+
+//magic bitboard slider attacks for one square
+typedef struct {
+  U64           mask;   //relevant occupancy (edges excluded)
+  U64           magic;  //magic multiplier
+  U64         * atk;    //attack board for this square
+  int           shift;  //64 - bits in mask
+} s_magic;
+
 //====================================================================
 //simon includes
 //====================================================================
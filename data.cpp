@@ -9,41 +9,50 @@ program variables.
 const char *name = "Simon v1.3 JA";    //name and version
 
 //=====================================================================
-//position & search variables.  These variables should be wrapped
-//up in a structure if you plan an smp implementation.
+//position & search variables.  These are thread_local so each 
+//thread (see perft.cpp and Iterate()) has its own copy.
 //=====================================================================
 //basic position data
-int color;                  //color moving
-int board[64];              //array board
-int castle[MAX_PLY+2];      //castle rights
-int ep_sq[MAX_PLY+2];       //ep square
-int g_ply[MAX_PLY+2];       //half move clock
+thread_local int color;                  //color moving
+thread_local int board[64];              //array board
+thread_local int castle[MAX_PLY+2];      //castle rights
+thread_local int ep_sq[MAX_PLY+2];       //ep square
+thread_local int g_ply[MAX_PLY+2];       //half move clock
 //bitboard position data
-U64 bbd[16];                //bitboards
-U64 bb_rl90;                //rotated bitboards
-U64 bb_rl45;
-U64 bb_rr45;
-U64 bb_move;                //bitboard move
-//hash keys & pin data
-U64 key_1;                  //transition hash key
-U64 key_2;                  //pawn hash key
-U64 pin_key1;
-U64 pin_save;
-U64 pin_mask[64];
+thread_local U64 bbd[16];                //bitboards
+#if !magic_bitboards
+thread_local U64 bb_rl90;                //rotated bitboards
+thread_local U64 bb_rl45;
+thread_local U64 bb_rr45;
+#endif
+thread_local U64 bb_move;                //bitboard move
+//hash keys
+thread_local U64 key_1;                  //transition hash key
+thread_local U64 key_2;                  //pawn hash key
+//check & pin data by ply
+thread_local s_check check_info[MAX_PLY+2];
 //piece counts & king locations
-int num_men[16];            //men/material counts
-int wk_sq;                  //white king square
-int bk_sq;                  //black king square
+thread_local int num_men[16];            //men/material counts
+thread_local int wk_sq;                  //white king square
+thread_local int bk_sq;                  //black king square
 //history heuristic
-unsigned hh_white[4096];
-unsigned hh_black[4096];
-unsigned hh_max;
+thread_local unsigned hh_white[4096];
+thread_local unsigned hh_black[4096];
+thread_local unsigned hh_max;
 //move list & search tree
-s_move move_list[4096];
-s_tree tree[MAX_PLY+2];
+thread_local s_move move_list[4096];
+thread_local s_tree tree[MAX_PLY+2];
+thread_local int root_moves;             //root moves
+thread_local s_move root_list[256];
+thread_local unsigned nodes;             //nodes searched
 //pv & eval
-int pv_len[MAX_PLY+2];
-int pv_move[MAX_PLY+2][MAX_PLY+2];
+thread_local int pv_len[MAX_PLY+2];
+thread_local int pv_move[MAX_PLY+2][MAX_PLY+2];
+//game history
+thread_local int hix;
+thread_local s_hist hist[MAX_HIX+2];
+//search context of the search this thread is working on
+thread_local s_search *srch;
 
 //=====================================================================
 //global variables
@@ -63,14 +72,13 @@ char men_lower[9] = " pkn brq";
 int kolor;                  //computer color
 int move_num;               //move number
 int game_over;              //FIN_XXX
-int abort_search;
-int iter;                   //current iteration
+int num_cores = 1;          //search threads, see Iterate()
+int multi_pv = 1;           //lines to report, the multipv command
 int draw_score = 0;
-unsigned  nodes;            //nodes searched
+int cpu_popcnt = FALSE;     //set by InitCPU()
 
-int root_score = 0;         //score
-int root_moves;             //root moves
-s_move root_list[256];
+s_search xb_search;         //search context of the xboard loop
+s_hash xb_hash;             //hash table of the xboard loop
 
 //winboard values
 int xb_level_moves;         //moves per control
@@ -86,17 +94,12 @@ bool xb_mode = FALSE;       //set w/xboard command
 
 //time control
 int tc_moves = 0;           //moves remaining to time control
-int tc_target = 2000;       //target search time 1/1000's sec
-int tc_start;
 
 //random numbers for hash keys
 U64 (*rnd_psq)[64];         //rnd_psq[16][64] piece/squares
 U64 rnd_epc[48] = {0};      //en passant/castle
 U64 rnd_btm;                //black to move
 
-int hix;                    //game history
-s_hist hist[MAX_HIX+2];
-
 char err_msg[64];           //buffer for error messages
 
 //all bits
@@ -321,3 +324,48 @@ const char shr_bish_rl45[64] = {
  21, 28, 36, 43, 49, 54, 58, 61,
  28, 36, 43, 49, 54, 58, 61, 63};
 
+//============================================================================
+//magic multipliers for the sliding piece attack boards.  multiplying the
+//relevant occupancy of a square by its magic gathers the occupancy bits
+//into the top of the product without destructive collisions.  see
+//InitAttack() in attack.cpp.
+//============================================================================
+const U64 magic_rook[64] = {
+  0x1080004008801020,0x0840092002c03000,0x1900200010400900,0x0880100008000480,
+  0x4200100420080200,0x8100020100080400,0x0200040110886200,0x0200008040220411,
+  0x0404800084400220,0x0000401000402000,0x0086001081220440,0x0408800800100280,
+  0x000a001201040820,0x8848800200840080,0x4001000100040200,0x0442000102105084,
+  0x9080010020804100,0x0040404000201009,0x0000808010002009,0x2200090021d00100,
+  0x0008008008040080,0x0004004002010040,0x0011040008015042,0x00000a0001768104,
+  0x0000800080204009,0x2010004140002001,0x9800200280100080,0x1000100080080080,
+  0x0442000a00049020,0x2100040080020080,0x0800120400900148,0x0010040a00128541,
+  0x2800804000800030,0x1010002000400041,0x4000200011004100,0x0610008410800800,
+  0x0400802402800800,0xc100020080800400,0x0002000802000401,0x0182085882000401,
+  0x0220204000808000,0x2860100040024022,0x0001002004110040,0x99101042000a0020,
+  0x0004080004008080,0x0010040002008080,0x2012004881020004,0x8300842444820011,
+  0x0088403882010200,0x0820400080210100,0x0110910040a00300,0x0801100280080480,
+  0x0242009008200600,0x1002000489500200,0x0040800200010080,0x0091800041000080,
+  0x0000209300488001,0x04c1002414824001,0x020020000b001041,0x7000100004200901,
+  0x8002002004100802,0x30010002084c0007,0x0888221800813004,0x4000002840840112};
+
+const U64 magic_bish[64] = {
+  0xa010041108003100,0x006082020a002900,0x6810010619200000,0x08281a0520000408,
+  0x0001104001000400,0x0018901008048400,0x00040a0210245280,0x000200210808a402,
+  0x9140048410821200,0x0800091010820041,0x20504804832202c0,0x0100091401081000,
+  0x8021011140000012,0x0810020804450400,0x208b0542109008a2,0x0080084a08040204,
+  0x0040e2a80811244c,0x2505022008008108,0x0430220100420040,0x010a040420220040,
+  0x1105000290400000,0x0093001200822120,0x4000a62048043004,0x280120048a015004,
+  0x006090002a020814,0x44042000240800d0,0x01102800040a4400,0x1004080080220040,
+  0x0001001011004024,0x0010044000805040,0x0914041200820100,0x0004821012821480,
+  0x0024040500c05021,0x0088611002080200,0x0116080a00040020,0x4000020080080080,
+  0x2450450140840040,0x0000880201484100,0x0222020404020092,0x8081110600002e00,
+  0x2842101105000801,0x1100809008001025,0x00020202221c0400,0x0422014022009020,
+  0x0210046102100c00,0xc004008082029102,0x00aa461801101200,0x0404080080201108,
+  0x020542108c205002,0x0410544804100100,0x0040910841100000,0x0400200042021100,
+  0x00004204850400c0,0x0200100410a42102,0x1040020801210102,0x0805040410420000,
+  0x2884804130100200,0x800c262201242000,0x1058000194108800,0x0014221054420204,
+  0x0104000012a02200,0x0200881003300100,0x0140400202840100,0x0402020801010201};
+
+//diagonal masks, set by InitAttack()
+U64 mask_rl45[64];          //a8-h1 diagonal through square
+U64 mask_rr45[64];          //a1-h8 diagonal through square
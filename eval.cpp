@@ -29,48 +29,48 @@ int Center(int b1) {
 }
   
 //====================================================================
-//Eval() evaluates the position.  returns score positive if side
-//moving stands better
+//EvalSide() returns the pawn, piece and mobility terms for side, 
+//positive if good for side.  It's a template on side so each color
+//gets its own copy with the color tests settled by the compiler.
 //====================================================================
-int Eval() {
+template <int side>
+static int EvalSide(int ply) {
   int b1, val;
   U64 men;
-  //material
-  val = white_mtl - black_mtl;
   //pawns
-  men = w_pawn;
-  val += 5 * BitCount(men & sweet_ctr);       //credit center pawns
-  while (men) {
-    b1 = FirstBit(men);
-    men &= sq_clr[b1];    
-    val += row(b1);                           //credit advancement
-    if (mask_col[col(b1)] & men) val -= 10;   //penalty if doubled
-  }
-  men = b_pawn;
-  val -= 5 * BitCount(men & sweet_ctr);
+  men = bbd[PAWN + side];
+  val = 5 * BitCount(men & sweet_ctr);        //credit center pawns
   while (men) {
     b1 = FirstBit(men);
     men &= sq_clr[b1];
-    val -= 7-row(b1);
-    if (mask_col[col(b1)] & men) val += 10;
+    val += side ? 7 - row(b1) : row(b1);      //credit advancement
+    if (mask_col[col(b1)] & men) val -= 10;   //penalty if doubled
   }
   //pieces
-  men = w_knight | w_bish;
+  men = bbd[KNIGHT + side] | bbd[BISHOP + side];
   while (men) {
     b1 = FirstBit(men);
     men &= sq_clr[b1];
     val += Center(b1);                        //credit centralization
   }
-  men = b_knight | b_bish;
-  while (men) {
-    b1 = FirstBit(men);
-    men &= sq_clr[b1];
-    val -= Center(b1);
-  }
+  //mobility - credit legal pawn and piece moves
+  val += Mobility(side, ply);
+  return val;
+}
+
+//====================================================================
+//Eval() evaluates the position at ply.  returns score positive if 
+//side moving stands better
+//====================================================================
+int Eval(int ply) {
+  int val;
+  //material
+  val = white_mtl - black_mtl;
+  //pawns, pieces & mobility
+  val += EvalSide<WHITE>(ply) - EvalSide<BLACK>(ply);
   //if endgame move king to center
   if ((w_pieces + b_pieces) < 5) val += Center(wk_sq) - Center(bk_sq);
   //negate score if black to move
   if (color == BLACK) val = -val;
   return val;
 }
-
@@ -39,80 +39,198 @@ static const int queen_pro = 1;
 static const int under_pro = 2;
 
 //====================================================================
-//SetPins() sets pins and pin_mask[] which tells us who is pinned and
-//where they can go.  If a pin is found we set pin_mask[] to the 
-//corresponding rank, file or diagonal from the king to and including
-//the pinnor.
-//====================================================================
-static U64 SetPins() {
-  int b1, b2, king;
-  U64 enemy, a1, d1;      //pinor and pinee
-  if (key_1 == pin_key1) {
-    return pin_save;
-  }
-  pin_key1 = key_1;
-  pin_save = 0;
-  if (color) {        //set black pins
-    king = bk_sq;
-    enemy = w_men;
-    d1 = b_men & atk_queen(king);
-  } else {            //set white pins
-    king = wk_sq;
-    enemy = b_men;
-    d1 = w_men & atk_queen(king);
-  }
+//FindBlockers() finds the men in own that stand alone between king
+//and a bishop, rook or queen in sliders.  If mask is not NULL it sets
+//mask[] for each one to the rank, file or diagonal from the king to 
+//and including the slider.  With sliders the enemy these are the men
+//pinned to king and mask[] tells us where they can go.  With sliders
+//our own they are the men that give discovered check if they move off
+//the line.
+//====================================================================
+static U64 FindBlockers(int king, U64 own, U64 sliders, U64 *mask) {
+  int b1, b2;
+  U64 a1, d1, found = 0;  //blockers next to king and those found
+  d1 = own & atk_queen(king);
   while (d1) {
     b1 = FirstBit(d1);
     d1 &= sq_clr[b1];
     switch (abs_val(directions[king][b1])) {
     case 1:
-      a1 = atk_rank(b1) & rook_queen & enemy;
+      a1 = atk_rank(b1) & rook_queen & sliders;
       break;
     case 7:
-      a1 = atk_rl45(b1) & bish_queen & enemy;
+      a1 = atk_rl45(b1) & bish_queen & sliders;
       break;
     case 8:
-      a1 = atk_file(b1) & rook_queen & enemy;
+      a1 = atk_file(b1) & rook_queen & sliders;
       break;
     case 9:
-      a1 = atk_rr45(b1) & bish_queen & enemy;
+      a1 = atk_rr45(b1) & bish_queen & sliders;
       break;
     }
     if (a1) {
-      pin_save |= sq_set[b1];
-      b2 = FirstBit(a1);
-      pin_mask[b1] = a1 | obstructed[king][b2];
+      found |= sq_set[b1];
+      if (mask) {
+        b2 = FirstBit(a1);
+        mask[b1] = a1 | obstructed[king][b2];
+      }
+    }
+  }
+  return found;
+}
+
+//====================================================================
+//FindPins() finds the men of side that are pinned to their king and
+//sets mask[] which tells us where they can go.
+//====================================================================
+static U64 FindPins(int side, U64 *mask) {
+  if (side) return FindBlockers(bk_sq, b_men, w_men, mask);
+  return FindBlockers(wk_sq, w_men, b_men, mask);
+}
+
+//====================================================================
+//SetCheck() returns the check info for the position at ply: who is
+//giving us check and our pinned men and where they can go.  The 
+//generators and the search all use it so it's saved by hash key and
+//we only work it out once per node.
+//====================================================================
+s_check *SetCheck(int ply) {
+  s_check *ck = &check_info[ply];
+  if (ck->key == key_1) return ck;
+  ck->key = key_1;
+  //Attacked() quits early and we are seldom in check
+  if (color) {
+    ck->checkers = Attacked(bk_sq, WHITE) ? Attacks(bk_sq) & w_men : 0;
+    ck->pins = FindBlockers(bk_sq, b_men, w_men, ck->pin_mask);
+  } else {
+    ck->checkers = Attacked(wk_sq, BLACK) ? Attacks(wk_sq) & b_men : 0;
+    ck->pins = FindBlockers(wk_sq, w_men, b_men, ck->pin_mask);
+  }
+  return ck;
+}
+
+//====================================================================
+//SetCheckSq() adds what GivesCheck() needs to the check info: our 
+//men that would uncover a check and, for each type of man, the 
+//squares from which it would give check.  Done only when asked for
+//since perft and most of the search don't need it.
+//====================================================================
+static void SetCheckSq(s_check *ck) {
+  int xking;
+  ck->check_key = key_1;
+  if (color) {
+    xking = wk_sq;
+    ck->disc = FindBlockers(xking, b_men, b_men, NULL);
+    ck->check_sq[PAWN] = ap_wpawn[xking];
+  } else {
+    xking = bk_sq;
+    ck->disc = FindBlockers(xking, w_men, w_men, NULL);
+    ck->check_sq[PAWN] = ap_bpawn[xking];
+  }
+  ck->check_sq[KNIGHT] = atk_knight(xking);
+  ck->check_sq[BISHOP] = atk_bish(xking);
+  ck->check_sq[ROOK] = atk_rook(xking);
+  ck->check_sq[QUEEN] = ck->check_sq[BISHOP] | ck->check_sq[ROOK];
+}
+
+//====================================================================
+//SlideCheck() returns TRUE if a man of type on b1 attacks b2 with the
+//board occupied by occ.  Used by GivesCheck() for the odd moves that 
+//change more than the from and to squares.
+//====================================================================
+static int SlideCheck(int type, int b1, int b2, U64 occ) {
+  int d1 = abs_val(directions[b1][b2]);
+  if (type == KNIGHT) return ((ap_knight[b1] & sq_set[b2]) != 0);
+  if (!d1 || (obstructed[b1][b2] & occ)) return FALSE;
+  if (type == QUEEN) return TRUE;
+  if (type == ROOK) return ((d1 == 1) || (d1 == 8));
+  return ((type == BISHOP) && ((d1 == 7) || (d1 == 9)));
+}
+
+//====================================================================
+//GivesCheck() returns TRUE if move, legal at ply, checks the enemy
+//king.  Most moves need only the check squares and discovered check
+//candidates from SetCheckSq().  Castling, en passant and promotions
+//are played out on an occupancy board.
+//====================================================================
+int GivesCheck(int move, int ply) {
+  s_check *ck = SetCheck(ply);
+  int b1 = mv_b1(move), b2 = mv_b2(move), man = mv_man(move), xking;
+  int b3, b4;
+  U64 occ, sliders;
+  xking = color ? wk_sq : bk_sq;
+  if (ck->check_key != key_1) SetCheckSq(ck);
+  //direct check (a promotion checks as the new man, see below)
+  if ((mv_spl(move) != 4) && (ck->check_sq[man & TYPE] & sq_set[b2]))
+    return TRUE;
+  //discovered check - moving off the line to the king
+  if ((ck->disc & sq_set[b1]) && 
+    (directions[xking][b1] != directions[xking][b2])) return TRUE;
+  switch (mv_spl(move)) {
+  case 1:   //O-O - only the rook can give check
+  case 2:   //O-O-O
+    b3 = (mv_spl(move) == 1) ? b1 + 1 : b1 - 1;   //rook to
+    b4 = (mv_spl(move) == 1) ? b1 + 3 : b1 - 4;   //rook from
+    occ = (occupied ^ sq_set[b1] ^ sq_set[b4]) | sq_set[b2] | sq_set[b3];
+    return SlideCheck(ROOK, b3, xking, occ);
+  case 3:   //PxP ep - the captured pawn may uncover a check
+    b3 = color ? b2 + 8 : b2 - 8;
+    occ = (occupied ^ sq_set[b1] ^ sq_set[b3]) | sq_set[b2];
+    sliders = (bish_queen | rook_queen) & (color ? b_men : w_men);
+    while (sliders) {
+      b4 = FirstBit(sliders);
+      sliders &= sq_clr[b4];
+      if (SlideCheck(board[b4] & TYPE, b4, xking, occ)) return TRUE;
     }
+    return FALSE;
+  case 4:   //promotion - the pawn no longer blocks the new piece
+    occ = occupied ^ sq_set[b1];
+    return SlideCheck(mv_pro(move), b2, xking, occ);
   }
-  return pin_save;
+  return FALSE;
+}
+
+//====================================================================
+//The generators below are templates on side, the color moving, so
+//each color gets its own copy with the color tests settled by the
+//compiler.  GenCap(), GenMov(), GenEvade(), CountMov(), Mobility()
+//and MoveValid() test color once and call the copy for the side to
+//move.  PawnPush() and PawnCapA()/PawnCapH() move a pawn bitboard
+//one square forward and one square forward toward the a/h file.
+//====================================================================
+template <int side> static inline U64 PawnPush(U64 men) {
+  return side ? men >> 8 : men << 8;
+}
+
+template <int side> static inline U64 PawnCapA(U64 men) {
+  return side ? (men & ~file_a) >> 9 : (men & ~file_a) << 7;
+}
+
+template <int side> static inline U64 PawnCapH(U64 men) {
+  return side ? (men & ~file_h) >> 7 : (men & ~file_h) << 9;
 }
 
 //====================================================================
 //AddEPCap() generates en passant captures.
 //target must be the en passant target square
 //====================================================================
-static s_move *AddEPCap(s_move *pm, int target, U64 pins) {
+template <int side>
+static s_move *AddEPCap(s_move *pm, int target, U64 pins, const U64 *mask) {
+  const int xside = side ^ KTC;
   U64 a1, men, enemy=0;
   int b1, b3, king, temp;
 
-  if (color) {      //black ep cap
-    men = b_pawn & ap_wpawn[target];
-    b3 = target+8;
-    king = bk_sq;
-    if (row(b3) == row(king)) enemy = (w_rook | w_queen) & mask_row[row(king)];
-    temp = (target<<6)|(BP<<20)|(WP<<16)|0x3000000;
-  } else {        //white ep cap
-    men = w_pawn & ap_bpawn[target];
-    b3 = target-8;
-    king = wk_sq;
-    if (row(b3) == row(king)) enemy = (b_rook | b_queen) & mask_row[row(king)];
-    temp = (target<<6)|(WP<<20)|(BP<<16)|0x3000000;
-  }
+  men = bbd[PAWN + side] & (side ? ap_wpawn[target] : ap_bpawn[target]);
+  b3 = side ? target + 8 : target - 8;    //pawn captured
+  king = side ? bk_sq : wk_sq;
+  if (row(b3) == row(king))
+    enemy = (bbd[ROOK + xside] | bbd[QUEEN + xside]) & mask_row[row(king)];
+  temp = (target<<6)|((PAWN + side)<<20)|((PAWN + xside)<<16)|0x3000000;
   while (men) {
     b1 = FirstBit(men);
     men &= sq_clr[b1];
     a1 = sq_set[target];
-    if (pins & sq_set[b1]) a1 &= pin_mask[b1];
+    if (pins & sq_set[b1]) a1 &= mask[b1];
     //make sure captured pawn is not sheltering an attack
     if (enemy && a1) {
       //king on pawn rank w/hostile rooks/queens
@@ -129,33 +247,26 @@ static s_move *AddEPCap(s_move *pm, int target, U64 pins) {
 //====================================================================
 //AddPawnPro() Generates pawn promotions.  Target can be all squares
 //====================================================================
-static s_move *AddPawnPro(s_move *pm, U64 target, U64 pins, int pro) {
-  U64 men, moves[3];
+template <int side>
+static s_move *AddPawnPro(s_move *pm, U64 target, U64 pins,
+  const U64 *mask, int pro) {
+  U64 men, enemy, moves[3];
   int i, delta, b1, b2, temp;
 
-  if (color) { //black pawn promotions
-    men = b_pawn & rank_2;
-    if (!men) return pm;
-    moves[0] = ((men & ~file_a) >> 9) & w_men & target;
-    moves[1] = (men >> 8) & empty & target;
-    moves[2] = ((men & ~file_h) >> 7) & w_men & target;
-    delta = -9;
-    temp = 0x4000000 | (BP<<20);
-  } else { //white pawn promotions
-    men = w_pawn & rank_7;
-    if (!men) return pm;
-    moves[0] = ((men & ~file_a) << 7) & b_men & target;
-    moves[1] = (men << 8) & empty & target;
-    moves[2] = ((men & ~file_h) << 9) & b_men & target;
-    delta = 7;
-    temp = 0x4000000 | (WP<<20);
-  }  
+  men = bbd[PAWN + side] & (side ? rank_2 : rank_7);
+  if (!men) return pm;
+  enemy = bbd[side ^ KTC];
+  moves[0] = PawnCapA<side>(men) & enemy & target;
+  moves[1] = PawnPush<side>(men) & empty & target;
+  moves[2] = PawnCapH<side>(men) & enemy & target;
+  delta = side ? -9 : 7;
+  temp = 0x4000000 | ((PAWN + side)<<20);
   for (i=0; i<3; i++) {
     while (moves[i]) {
       b2 = FirstBit(moves[i]);
       moves[i] &= sq_clr[b2];
       b1 = b2 - delta;
-      if ((!(pins & sq_set[b1])) || (sq_set[b2] & pin_mask[b1])) {
+      if ((!(pins & sq_set[b1])) || (sq_set[b2] & mask[b1])) {
         if (pro & queen_pro) {
           (pm++)->move = b1|(b2 << 6)|temp|(board[b2]<<16)|(QUEEN << 12);
         }
@@ -167,179 +278,112 @@ static s_move *AddPawnPro(s_move *pm, U64 target, U64 pins, int pro) {
       }
     } //while moves
     delta++;
-  } //for i      
+  } //for i
   return pm;
 }
 
 //====================================================================
-//AddXPawnCap() generates non promotion pawn captures (except ep caps)
+//AddPawnCap() generates non promotion pawn captures (except ep caps)
 //Target can be all squares.
 //====================================================================
-static s_move *AddBPawnCap(s_move *pm, U64 target, U64 pins) {
-  int b1, b2;
-  U64 men, moves1, moves2;
-  men = b_pawn & (~rank_2);
-  target &= w_men;
-  moves1 = ((men & ~file_a) >> 9) & target;
-  moves2 = ((men & ~file_h) >> 7) & target;
-  if (pins) { //pawn cap - pins
-    while (moves1) {
-      b2 = FirstBit(moves1);
-      moves1 &= sq_clr[b2];
-      b1 = b2 + 9;
-      if ((!(pins & sq_set[b1])) || (sq_set[b2] & pin_mask[b1])) {
-        (pm++)->move = b1|(b2<<6)|(BP << 20)|(board[b2]<<16);
-      }
-    }
-    while (moves2) {
-      b2 = FirstBit(moves2);
-      moves2 &= sq_clr[b2];
-      b1 = b2 + 7;
-      if ((!(pins & sq_set[b1])) || (sq_set[b2] & pin_mask[b1])) {
-        (pm++)->move = b1|(b2<<6)|(BP<<20)|(board[b2]<<16);
-      }
-    }
-  } else { //pawn cap - no pins
-    while (moves1) {
-      b2 = FirstBit(moves1);
-      moves1 &= sq_clr[b2];
-      (pm++)->move = (b2+9)|(b2<<6)|(BP<<20)|(board[b2]<<16);
-    }
-    while (moves2) {
-      b2 = FirstBit(moves2);
-      moves2 &= sq_clr[b2];
-      (pm++)->move = (b2+7)|(b2<<6)|(BP<<20)|(board[b2]<<16);
-    }
-  } //if pins
-  return pm;
-} //AddBPawnCap()
-
-static s_move *AddWPawnCap(s_move *pm, U64 target, U64 pins) {
+template <int side>
+static s_move *AddPawnCap(s_move *pm, U64 target, U64 pins,
+  const U64 *mask) {
+  const int d1 = side ? 9 : -7;   //to -> from, a file side
+  const int d2 = side ? 7 : -9;   //to -> from, h file side
+  const int temp = (PAWN + side) << 20;
   int b1, b2;
   U64 men, moves1, moves2;
-  men = w_pawn & (~rank_7);
-  target &= b_men;
-  moves1 = ((men & ~file_a) << 7) & target;
-  moves2 = ((men & ~file_h) << 9) & target;
+  men = bbd[PAWN + side] & ~(side ? rank_2 : rank_7);
+  target &= bbd[side ^ KTC];
+  moves1 = PawnCapA<side>(men) & target;
+  moves2 = PawnCapH<side>(men) & target;
   if (pins) { //pawn cap - pins
     while (moves1) {
       b2 = FirstBit(moves1);
       moves1 &= sq_clr[b2];
-      b1 = b2 - 7;
-      if ((!(pins & sq_set[b1])) || (sq_set[b2] & pin_mask[b1])) {
-        (pm++)->move = b1|(b2<<6)|(WP<<20)|(board[b2]<<16);
+      b1 = b2 + d1;
+      if ((!(pins & sq_set[b1])) || (sq_set[b2] & mask[b1])) {
+        (pm++)->move = b1|(b2<<6)|temp|(board[b2]<<16);
       }
     }
     while (moves2) {
       b2 = FirstBit(moves2);
       moves2 &= sq_clr[b2];
-      b1 = b2 - 9;
-      if ((!(pins & sq_set[b1])) || (sq_set[b2] & pin_mask[b1])) {
-        (pm++)->move = b1|(b2<<6)|(WP<<20)|(board[b2]<<16);
+      b1 = b2 + d2;
+      if ((!(pins & sq_set[b1])) || (sq_set[b2] & mask[b1])) {
+        (pm++)->move = b1|(b2<<6)|temp|(board[b2]<<16);
       }
     }
   } else { //pawn cap - no pins
     while (moves1) {
       b2 = FirstBit(moves1);
       moves1 &= sq_clr[b2];
-      (pm++)->move = (b2-7)|(b2<<6)|(WP<<20)|(board[b2]<<16);
+      (pm++)->move = (b2+d1)|(b2<<6)|temp|(board[b2]<<16);
     }
     while (moves2) {
       b2 = FirstBit(moves2);
       moves2 &= sq_clr[b2];
-      (pm++)->move = (b2-9)|(b2<<6)|(WP<<20)|(board[b2]<<16);
+      (pm++)->move = (b2+d2)|(b2<<6)|temp|(board[b2]<<16);
     }
   } //if pins
   return pm;
-} //AddWPawnCap()
+} //AddPawnCap()
 
 //====================================================================
-//AddXPawnAdv() generates pawn non capture moves.
+//AddPawnAdv() generates pawn non capture moves.
 //Target can be all squares.
 //====================================================================
-static s_move *AddBPawnAdv(s_move *pm, U64 target, U64 pins) {
-  int b1, b2;
-  U64 men, moves1, moves2;
-  men = b_pawn & ~rank_2;
-  moves1 = (men >> 8) & empty;
-  moves2 = ((moves1 & rank_6) >> 8) & empty & target;
-  moves1 &= target;
-  if (pins) { //pawn mov - pins
-    while (moves1) {
-      b2 = FirstBit(moves1);
-      moves1 &= sq_clr[b2];
-      b1 = b2 + 8;
-      if ((!(pins & sq_set[b1])) || (sq_set[b2] & pin_mask[b1])) {
-        (pm++)->move = b1|(b2<<6)|(BP<<20);
-      }
-    }
-    while (moves2) {
-      b2 = FirstBit(moves2);
-      moves2 &= sq_clr[b2];
-      b1 = b2 + 16;
-      if ((!(pins & sq_set[b1])) || (sq_set[b2] & pin_mask[b1])) {
-        (pm++)->move = b1|(b2<<6)|((BP<<20)|0x5000000);
-      }
-    }
-  } else { //pawn mov - no pins
-    while (moves1) {
-      b2 = FirstBit(moves1);
-      moves1 &= sq_clr[b2];
-      (pm++)->move = (b2 + 8)|(b2<<6)|(BP<<20);
-    }
-    while (moves2) {
-      b2 = FirstBit(moves2);
-      moves2 &= sq_clr[b2];
-      (pm++)->move = (b2 + 16)|(b2<<6)|((BP<<20)|0x5000000);
-    }
-  } //if pins
-  return pm;
-} //AddBPawnAdv()
-
-static s_move *AddWPawnAdv(s_move *pm, U64 target, U64 pins) {
+template <int side>
+static s_move *AddPawnAdv(s_move *pm, U64 target, U64 pins,
+  const U64 *mask) {
+  const int d1 = side ? 8 : -8;   //to -> from
+  const int temp = (PAWN + side) << 20;
   int b1, b2;
   U64 men, moves1, moves2;
-  men = w_pawn & ~rank_7;
-  moves1 = (men << 8) & empty;
-  moves2 = ((moves1 & rank_3) << 8) & empty & target;
+  men = bbd[PAWN + side] & ~(side ? rank_2 : rank_7);
+  moves1 = PawnPush<side>(men) & empty;
+  moves2 = PawnPush<side>(moves1 & (side ? rank_6 : rank_3)) & empty & target;
   moves1 &= target;
   if (pins) { //pawn mov - pins
     while (moves1) {
       b2 = FirstBit(moves1);
       moves1 &= sq_clr[b2];
-      b1 = b2 - 8;
-      if ((!(pins & sq_set[b1])) || (sq_set[b2] & pin_mask[b1])) {
-        (pm++)->move = b1|(b2<<6)|(WP<<20);
+      b1 = b2 + d1;
+      if ((!(pins & sq_set[b1])) || (sq_set[b2] & mask[b1])) {
+        (pm++)->move = b1|(b2<<6)|temp;
       }
     }
     while (moves2) {
       b2 = FirstBit(moves2);
       moves2 &= sq_clr[b2];
-      b1 = b2 - 16;
-      if ((!(pins & sq_set[b1])) || (sq_set[b2] & pin_mask[b1])) {
-        (pm++)->move = b1|(b2<<6)|((WP<<20)|0x5000000);
+      b1 = b2 + 2 * d1;
+      if ((!(pins & sq_set[b1])) || (sq_set[b2] & mask[b1])) {
+        (pm++)->move = b1|(b2<<6)|temp|0x5000000;
       }
     }
   } else { //pawn mov - no pins
     while (moves1) {
       b2 = FirstBit(moves1);
       moves1 &= sq_clr[b2];
-      (pm++)->move = (b2 - 8)|(b2<<6)|(WP<<20);
+      (pm++)->move = (b2 + d1)|(b2<<6)|temp;
     }
     while (moves2) {
       b2 = FirstBit(moves2);
       moves2 &= sq_clr[b2];
-      (pm++)->move = (b2 - 16)|(b2<<6)|((WP<<20)|0x5000000);
+      (pm++)->move = (b2 + 2 * d1)|(b2<<6)|temp|0x5000000;
     }
   } //if pins
   return pm;
-} //AddWPawnAdv()
+} //AddPawnAdv()
 
 //====================================================================
 //AddPieceMov() generates piece capture & non capture moves.
 //target must have correct target squares.
 //====================================================================
-static s_move *AddPieceMov(s_move *pm, U64 target, U64 &pins, U64 men) {
+template <int side>
+static s_move *AddPieceMov(s_move *pm, U64 target, U64 &pins, 
+  const U64 *mask, U64 men) {
   int b1, b2, c1, temp;
   U64 moves;
   assert((men & (w_pawn | b_pawn))==0);
@@ -353,13 +397,13 @@ static s_move *AddPieceMov(s_move *pm, U64 target, U64 &pins, U64 men) {
     case KNIGHT:
       continue;
     case BISHOP:
-      moves = atk_bish(b1) & target & pin_mask[b1];
+      moves = atk_bish(b1) & target & mask[b1];
       break;
     case ROOK:
-      moves = atk_rook(b1) & target & pin_mask[b1];
+      moves = atk_rook(b1) & target & mask[b1];
       break;
     case QUEEN:
-      moves = atk_queen(b1) & target & pin_mask[b1];
+      moves = atk_queen(b1) & target & mask[b1];
       break;
     case KING:
       assert(0);   //uh oh
@@ -392,7 +436,7 @@ static s_move *AddPieceMov(s_move *pm, U64 target, U64 &pins, U64 men) {
       break;
     case KING:
       moves = atk_king(b1) & target;
-      c1 = color ^ KTC;    //enemy color
+      c1 = side ^ KTC;     //enemy color
       while (moves) {
         b2 = FirstBit(moves);
         moves &= sq_clr[b2];
@@ -412,29 +456,11 @@ static s_move *AddPieceMov(s_move *pm, U64 target, U64 &pins, U64 men) {
 }
 
 //====================================================================
-//GenCap() generates captures & queen promotions
-//====================================================================
-s_move *GenCap(s_move *pm, int ply) {
-  U64 pins = SetPins();
-  //we do piece moves first since they can clear pins
-  if (color) {
-    pm = AddPieceMov(pm, w_men, pins, b_men & ~b_pawn);
-    pm = AddBPawnCap(pm, all_64, pins);
-  } else {
-    pm = AddPieceMov(pm, b_men, pins, w_men & ~w_pawn);
-    pm = AddWPawnCap(pm, all_64, pins);
-  }
-  if (ep_sq[ply]) pm = AddEPCap(pm, ep_sq[ply], pins);
-  return AddPawnPro(pm, all_64, pins, queen_pro);
-}
-
-//====================================================================
-//GenMov() generates non captures & under promotions
+//AddCastle() generates castle moves.  Must not be in check.
 //====================================================================
-s_move *GenMov(s_move *pm, int ply) {
-  U64 pins = SetPins();
-  if (color) {      //black moves
-    //black castle
+template <int side>
+static s_move *AddCastle(s_move *pm, int ply) {
+  if (side) {       //black castle
     if ((castle[ply] & 4) && !(occupied & mask_bck) &&
       !Attacked(F8, WHITE) && !Attacked(G8, WHITE)) {
       (pm++)->move = 27267004;
@@ -443,11 +469,7 @@ s_move *GenMov(s_move *pm, int ply) {
       !Attacked(C8, WHITE) && !Attacked(D8, WHITE)) {
       (pm++)->move = 44043964;
     }
-    //black moves
-    pm = AddPieceMov(pm, empty, pins, b_men & ~b_pawn);
-    pm = AddBPawnAdv(pm, all_64, pins);
-  } else {        //white moves
-    //white castle
+  } else {          //white castle
     if ((castle[ply] & 1) && !(occupied & mask_wck) &&
       !Attacked(F1, BLACK) && !Attacked(G1, BLACK)) {
       (pm++)->move = 18874756;
@@ -456,119 +478,307 @@ s_move *GenMov(s_move *pm, int ply) {
       !Attacked(C1, BLACK) && !Attacked(D1, BLACK)) {
       (pm++)->move = 35651716;
     }
-    //white moves
-    pm = AddPieceMov(pm, empty, pins, w_men & ~w_pawn);
-    pm = AddWPawnAdv(pm, all_64, pins);
   }
-  return AddPawnPro(pm, all_64, pins, under_pro);
+  return pm;
+}
+
+//====================================================================
+//GenCap() generates captures & queen promotions
+//====================================================================
+template <int side>
+static s_move *GenCap(s_move *pm, int ply) {
+  s_check *ck = SetCheck(ply);
+  U64 pins = ck->pins;
+  //we do piece moves first since they can clear pins
+  pm = AddPieceMov<side>(pm, bbd[side ^ KTC], pins, ck->pin_mask,
+    bbd[side] & ~bbd[PAWN + side]);
+  pm = AddPawnCap<side>(pm, all_64, pins, ck->pin_mask);
+  if (ep_sq[ply]) pm = AddEPCap<side>(pm, ep_sq[ply], pins, ck->pin_mask);
+  return AddPawnPro<side>(pm, all_64, pins, ck->pin_mask, queen_pro);
+}
+
+s_move *GenCap(s_move *pm, int ply) {
+  return color ? GenCap<BLACK>(pm, ply) : GenCap<WHITE>(pm, ply);
+}
+
+//====================================================================
+//GenMov() generates non captures & under promotions
+//====================================================================
+template <int side>
+static s_move *GenMov(s_move *pm, int ply) {
+  s_check *ck = SetCheck(ply);
+  U64 pins = ck->pins;
+  pm = AddCastle<side>(pm, ply);
+  pm = AddPieceMov<side>(pm, empty, pins, ck->pin_mask,
+    bbd[side] & ~bbd[PAWN + side]);
+  pm = AddPawnAdv<side>(pm, all_64, pins, ck->pin_mask);
+  return AddPawnPro<side>(pm, all_64, pins, ck->pin_mask, under_pro);
+}
+
+s_move *GenMov(s_move *pm, int ply) {
+  return color ? GenMov<BLACK>(pm, ply) : GenMov<WHITE>(pm, ply);
 }
 
 //====================================================================
 //GenEvade() generates check evasions
 //====================================================================
-s_move *GenEvade(s_move *pm, int ply) {
-  U64 target = 0, pins, moves, attacks;
-  int b1, b2, temp, num;
+template <int side>
+static s_move *GenEvade(s_move *pm, int ply) {
+  const int xpawn = PAWN + (side ^ KTC);    //enemy pawn
+  s_check *ck = SetCheck(ply);
+  U64 target = 0, pins = ck->pins, moves, attacks = ck->checkers;
+  int b1, b2, temp, num, ep = ep_sq[ply];
   int dir1 = 0, dir2 = 0;
 
-  if (color) {    //black in check
-    //first, see who is giving check and where they reside
-    b1 = bk_sq;
-    attacks = Attacks(b1) & w_men;
-    num = BitCount(attacks);
-    b2 = FirstBit(attacks);
-    if (num == 1) {
-      dir1 = directions[b2][b1];
-      if (dir1) { //dir1 is 0 if the checking piece is a knight
-        target = obstructed[b1][b2];
-        //unlike a bishop or rook we can run away from a pawn in
-        //the opposite direction
-        if (board[b2] == WP) dir1 = 0;
-      }
-      target |= attacks;
-    } else {
-      if (board[b2] != WP) dir1 = directions[b2][b1];
-      attacks &= sq_clr[b2];
-      b2 = FirstBit(attacks);
-      if (board[b2] != WP) dir2 = directions[b2][b1];
+  //first, see who is giving check and where they reside
+  b1 = side ? bk_sq : wk_sq;
+  num = BitCount(attacks);
+  b2 = FirstBit(attacks);
+  if (num == 1) {
+    dir1 = directions[b2][b1];
+    if (dir1) { //dir1 is 0 if the checking piece is a knight
+      target = obstructed[b1][b2];
+      //unlike a bishop or rook we can run away from a pawn in
+      //the opposite direction
+      if (board[b2] == xpawn) dir1 = 0;
     }
-    //black king evasions.  look for squares not attacked and squares
-    //not in the opposite direction of attack
-    temp = b1 + (BK << 20);
-    moves = ap_king[b1] & ~b_men;
-    while (moves) {
-      b2 = FirstBit(moves);
-      moves &= sq_clr[b2];
-      if (!Attacked(b2, WHITE) && (directions[b1][b2] != dir1)
-        && (directions[b1][b2] != dir2)) {
-        (pm++)->move = temp | (b2 << 6) | (board[b2] << 16);
-      }
-    }
-    //if there are multiple attackors we are done as the only way
-    //out of check is move the king.
-    if (num > 1) return (pm);
-    //only one attackor - look for pieces that can capture the
-    //offender or block the attack
-    pins = SetPins();
-    pm = AddPieceMov(pm, target, pins, b_men & ~(b_pawn|b_king));
-    pm = AddBPawnAdv(pm, target, pins);
-    pm = AddBPawnCap(pm, target, pins);
-    //if there is an ep capture possible we look to see if (1) putting
-    //our pawn on the ep_square will intervine (? possible) and (2) if
-    //that's the little bugger checking us.
-    if (ep_sq[ply] && ((sq_set[ep_sq[ply]] & target) || 
-      (b_king & ap_wpawn[ep_sq[ply]+8])))
-      pm = AddEPCap(pm, ep_sq[ply], pins);
-  } else {        //white in check
-    //first, see who is giving check and where they reside
-    b1 = wk_sq;
-    attacks = Attacks(b1) & b_men;
-    num = BitCount(attacks);
+    target |= attacks;
+  } else {
+    if (board[b2] != xpawn) dir1 = directions[b2][b1];
+    attacks &= sq_clr[b2];
     b2 = FirstBit(attacks);
-    if (num == 1) {
-      dir1 = directions[b2][b1];
-      if (dir1) { //dir1 is 0 if the checking piece is a knight
-        target = obstructed[b1][b2];
-        //unlike a bishop or rook we can run away from a pawn in
-        //the opposite direction
-        if (board[b2] == BP) dir1 = 0;
-      }
-      target |= attacks;
-    } else {
-      if (board[b2] != BP) dir1 = directions[b2][b1];
-      attacks &= sq_clr[b2];
-      b2 = FirstBit(attacks);
-      if (board[b2] != BP) dir2 = directions[b2][b1];
+    if (board[b2] != xpawn) dir2 = directions[b2][b1];
+  }
+  //king evasions.  look for squares not attacked and squares not in
+  //the opposite direction of attack
+  temp = b1 + ((KING + side) << 20);
+  moves = ap_king[b1] & ~bbd[side];
+  while (moves) {
+    b2 = FirstBit(moves);
+    moves &= sq_clr[b2];
+    if (!Attacked(b2, side ^ KTC) && (directions[b1][b2] != dir1)
+      && (directions[b1][b2] != dir2)) {
+      (pm++)->move = temp | (b2 << 6) | (board[b2] << 16);
     }
-    //white king evasions.  look for squares not attacked and squares
-    //not in the opposite direction of attack
-    temp = b1 + (WK << 20);
-    moves = ap_king[b1] & ~w_men;
-    while (moves) {
-      b2 = FirstBit(moves);
-      moves &= sq_clr[b2];
-      if (!Attacked(b2, BLACK) && (directions[b1][b2] != dir1)
-        && (directions[b1][b2] != dir2)) {
-        (pm++)->move = temp | (b2 << 6) | (board[b2] << 16);
-      }
+  }
+  //if there are multiple attackors we are done as the only way
+  //out of check is move the king.
+  if (num > 1) return (pm);
+  //only one attackor - look for pieces that can capture the
+  //offender or block the attack
+  pm = AddPieceMov<side>(pm, target, pins, ck->pin_mask,
+    bbd[side] & ~(bbd[PAWN + side] | bbd[KING + side]));
+  pm = AddPawnAdv<side>(pm, target, pins, ck->pin_mask);
+  pm = AddPawnCap<side>(pm, target, pins, ck->pin_mask);
+  //if there is an ep capture possible we look to see if (1) putting
+  //our pawn on the ep_square will intervine (? possible) and (2) if
+  //that's the little bugger checking us.
+  if (ep && ((sq_set[ep] & target) || (bbd[KING + side] &
+    (side ? ap_wpawn[ep + 8] : ap_bpawn[ep - 8]))))
+    pm = AddEPCap<side>(pm, ep, pins, ck->pin_mask);
+  return AddPawnPro<side>(pm, target, pins, ck->pin_mask,
+    queen_pro|under_pro);
+}
+
+s_move *GenEvade(s_move *pm, int ply) {
+  return color ? GenEvade<BLACK>(pm, ply) : GenEvade<WHITE>(pm, ply);
+}
+
+//====================================================================
+//CountPieceMov() counts legal pawn, knight, bishop, rook and queen
+//moves for side without generating them.  pins and mask[] are from
+//FindPins().  Unpinned pawns are counted all at once by shifting the
+//pawn bitboard.  A promotion counts 4 moves.  King moves, castling
+//and en passant are not counted and side must not be in check.  Side
+//need not be the side to move.
+//====================================================================
+template <int side>
+static int CountPieceMov(U64 pins, const U64 *mask) {
+  const U64 push2 = side ? rank_6 : rank_3;   //can advance 2 squares
+  const U64 last = side ? rank_1 : rank_8;    //promotion rank
+  int b1, num = 0;
+  U64 men, own, enemy, moves, pawns, p1, p2, p3;
+  own = bbd[side];
+  enemy = bbd[side ^ KTC];
+  men = own & ~(bbd[PAWN + side] | bbd[KING + side]);
+  while (men) {
+    b1 = FirstBit(men);
+    men &= sq_clr[b1];
+    switch (board[b1] & TYPE) {
+    case KNIGHT:
+      if (pins & sq_set[b1]) continue;    //pinned knight can't move
+      moves = atk_knight(b1);
+      break;
+    case BISHOP:
+      moves = atk_bish(b1);
+      break;
+    case ROOK:
+      moves = atk_rook(b1);
+      break;
+    default:
+      moves = atk_queen(b1);
+      break;
+    }
+    if (pins & sq_set[b1]) moves &= mask[b1];
+    num += BitCount(moves & ~own);
+  }
+  //pawns
+  pawns = bbd[PAWN + side] & ~pins;
+  p1 = PawnPush<side>(pawns) & empty;
+  p2 = PawnCapA<side>(pawns) & enemy;
+  p3 = PawnCapH<side>(pawns) & enemy;
+  num += BitCount(PawnPush<side>(p1 & push2) & empty);
+  num += BitCount(p1) + BitCount(p2) + BitCount(p3);
+  num += 3 * (BitCount(p1 & last) + BitCount(p2 & last) +
+    BitCount(p3 & last));
+  pawns = bbd[PAWN + side] & pins;
+  while (pawns) {
+    b1 = FirstBit(pawns);
+    pawns &= sq_clr[b1];
+    p1 = PawnPush<side>(sq_set[b1]) & empty;
+    moves = p1 | (PawnPush<side>(p1 & push2) & empty) |
+      ((side ? ap_bpawn[b1] : ap_wpawn[b1]) & enemy);
+    moves &= mask[b1];
+    num += BitCount(moves) + 3 * BitCount(moves & last);
+  }
+  return num;
+}
+
+//====================================================================
+//CountMov() returns the number of legal moves without generating
+//them (except evasions when in check, which are few).  It's the
+//counting sibling of GenCap()/GenMov()/GenEvade() and makes the
+//last ply of a perft much faster.
+//====================================================================
+template <int side>
+static int CountMov(int ply) {
+  s_move temp[256], *pm;
+  s_check *ck = SetCheck(ply);
+  U64 moves;
+  int b1, b2, num;
+  if (ck->checkers) return GenEvade<side>(temp, ply) - temp;
+  num = CountPieceMov<side>(ck->pins, ck->pin_mask);
+  //king moves
+  b1 = side ? bk_sq : wk_sq;
+  moves = atk_king(b1) & ~bbd[side];
+  while (moves) {
+    b2 = FirstBit(moves);
+    moves &= sq_clr[b2];
+    if (!Attacked(b2, side ^ KTC)) num++;
+  }
+  //castling & en passant are rare enough to just generate
+  pm = AddCastle<side>(temp, ply);
+  if (ep_sq[ply]) pm = AddEPCap<side>(pm, ep_sq[ply], ck->pins, ck->pin_mask);
+  return num + (pm - temp);
+}
+
+int CountMov(int ply) {
+  return color ? CountMov<BLACK>(ply) : CountMov<WHITE>(ply);
+}
+
+//====================================================================
+//Mobility() returns the number of legal pawn and piece (not king)
+//moves for side in the position at ply.  Used by Eval().  Not exact
+//if side is in check.
+//====================================================================
+int Mobility(int side, int ply) {
+  s_check *ck;
+  U64 pins, mask[64];
+  if (side == color) {
+    ck = SetCheck(ply);
+    if (side) return CountPieceMov<BLACK>(ck->pins, ck->pin_mask);
+    return CountPieceMov<WHITE>(ck->pins, ck->pin_mask);
+  }
+  pins = FindPins(side, mask);
+  if (side) return CountPieceMov<BLACK>(pins, mask);
+  return CountPieceMov<WHITE>(pins, mask);
+}
+
+//====================================================================
+//MoveValid() returns TRUE if move is legal in the current position.
+//Used to check hash and killer moves before we play them without
+//generating moves.  Hash moves can be garbage (two positions can share
+//a hash key) so we trust nothing but the move format and insist the
+//move be exactly what the generators would produce.  The side to move
+//must not be in check.
+//====================================================================
+template <int side>
+static int MoveValid(int move, int ply) {
+  s_move temp[16], *pm, *pm2;
+  s_check *ck;
+  int b1, b2, man, cap, dir;
+  U64 pins, a1;
+
+  b1 = mv_b1(move);
+  b2 = mv_b2(move);
+  man = mv_man(move);
+  cap = mv_cap(move);
+  if (!move || !man || (board[b1] != man) || ((man & KTC) != side))
+    return FALSE;
+  ck = SetCheck(ply);
+  pins = ck->pins;
+  pm2 = temp;
+  switch (mv_spl(move)) {
+  case 1:   //castle - compare with the real thing
+  case 2:
+    pm2 = AddCastle<side>(temp, ply);
+    break;
+  case 3:   //PxP ep
+    if (ep_sq[ply])
+      pm2 = AddEPCap<side>(temp, ep_sq[ply], pins, ck->pin_mask);
+    break;
+  case 4:   //pawn promotion
+    pm2 = AddPawnPro<side>(temp, sq_set[b2], pins, ck->pin_mask,
+      queen_pro|under_pro);
+    break;
+  case 5:   //pawn 2 square advance
+    dir = side ? -8 : 8;
+    if ((man & TYPE) != PAWN || (b2 != b1 + 2 * dir) ||
+      (sq_set[b1] & (side ? ~rank_7 : ~rank_2)) ||
+      (occupied & (sq_set[b1 + dir] | sq_set[b2]))) return FALSE;
+    if ((pins & sq_set[b1]) && !(ck->pin_mask[b1] & sq_set[b2])) return FALSE;
+    return (move == (b1|(b2<<6)|(man<<20)|0x5000000));
+  case 0:   //normal move
+    if ((board[b2] != cap) || (cap && ((cap & KTC) == side)) ||
+      ((cap & TYPE) == KING)) return FALSE;
+    if (move != (b1|(b2<<6)|(man<<20)|(cap<<16))) return FALSE;
+    switch (man & TYPE) {
+    case PAWN:
+      if (sq_set[b2] & (rank_1 | rank_8)) return FALSE;  //promotion
+      if (cap) a1 = side ? atk_bpawn(b1) : atk_wpawn(b1);
+      else a1 = sq_set[side ? b1 - 8 : b1 + 8];
+      break;
+    case KNIGHT:
+      a1 = atk_knight(b1);
+      break;
+    case BISHOP:
+      a1 = atk_bish(b1);
+      break;
+    case ROOK:
+      a1 = atk_rook(b1);
+      break;
+    case QUEEN:
+      a1 = atk_queen(b1);
+      break;
+    case KING:
+      //not in check so the king can't be hiding the square from a
+      //slider behind it
+      return ((atk_king(b1) & sq_set[b2]) && !Attacked(b2, side ^ KTC));
+    default:
+      return FALSE;
     }
-    //if there are multiple attackors we are done as the only way
-    //out of check is move the king.
-    if (num > 1) return (pm);
-    //only one attackor - look for pieces that can capture the
-    //offender or block the attack
-    pins = SetPins();
-    pm = AddPieceMov(pm, target, pins, w_men & ~(w_pawn|w_king));
-    pm = AddWPawnAdv(pm, target, pins);
-    pm = AddWPawnCap(pm, target, pins);
-    //if there is an ep capture possible we look to see if (1) putting
-    //our pawn on the ep_square will intervine (? possible) and (2) if
-    //that's the little bugger checking us.
-    if (ep_sq[ply] && ((sq_set[ep_sq[ply]] & target) || 
-      (w_king & ap_bpawn[ep_sq[ply]-8])))
-      pm = AddEPCap(pm, ep_sq[ply], pins);
-  } //if color
-  return AddPawnPro(pm, target, pins, queen_pro|under_pro);
+    if (!(a1 & sq_set[b2])) return FALSE;
+    if ((pins & sq_set[b1]) && !(ck->pin_mask[b1] & sq_set[b2])) return FALSE;
+    return TRUE;
+  }
+  for (pm = temp; pm < pm2; pm++) {
+    if (pm->move == move) return TRUE;
+  }
+  return FALSE;
+}
+
+int MoveValid(int move, int ply) {
+  return color ? MoveValid<BLACK>(move, ply) : MoveValid<WHITE>(move, ply);
 }
 
 //====================================================================
@@ -577,7 +787,7 @@ s_move *GenEvade(s_move *pm, int ply) {
 //====================================================================
 void GenRoot(void) {
   s_move *pm = root_list;
-  if (incheck) pm = GenEvade(pm, 0);
+  if (SetCheck(0)->checkers) pm = GenEvade(pm, 0);
   else pm = GenMov(GenCap(pm, 0), 0);
   root_moves = pm - root_list;
 }
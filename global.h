@@ -15,20 +15,32 @@ extern const char  *name;
 //position & search variables.
 //=====================================================================
 //basic position data
-extern int color, board[], castle[], ep_sq[], g_ply[];
+extern thread_local int color, board[], castle[], ep_sq[], g_ply[];
 //bitboard position data
-extern U64 bbd[16], bb_rl90, bb_rl45, bb_rr45, bb_move;
-//hash keys & pin data
-extern U64 key_1, key_2, pin_key1, pin_save, pin_mask[];
+extern thread_local U64 bbd[16], bb_move;
+#if !magic_bitboards
+extern thread_local U64 bb_rl90, bb_rl45, bb_rr45;
+#endif
+//hash keys
+extern thread_local U64 key_1, key_2;
+//check & pin data by ply
+extern thread_local s_check check_info[];
 //piece counts, material & king locations
-extern int num_men[], wk_sq, bk_sq;
+extern thread_local int num_men[], wk_sq, bk_sq;
 //history heuristic
-extern unsigned hh_white[], hh_black[], hh_max;
+extern thread_local unsigned hh_white[], hh_black[], hh_max;
 //move list & search tree
-extern s_move   move_list[];
-extern s_tree   tree[];
+extern thread_local s_move   move_list[];
+extern thread_local s_tree   tree[];
+extern thread_local int      root_moves;
+extern thread_local s_move   root_list[];
+extern thread_local unsigned nodes;
 //pv
-extern int pv_len[], pv_move[][MAX_PLY+2];
+extern thread_local int pv_len[], pv_move[][MAX_PLY+2];
+//game history & search context
+extern thread_local int hix;
+extern thread_local s_hist hist[];
+extern thread_local s_search *srch;
 
 //=====================================================================
 //global variables.
@@ -36,11 +48,10 @@ extern int pv_len[], pv_move[][MAX_PLY+2];
 extern const int    p_val, n_val, b_val, r_val, q_val;
 extern const int    piece_value[];
 
-extern int          kolor, move_num, hix, game_over;
+extern int          kolor, move_num, game_over;
 
-extern int          root_score;
-extern int          root_moves;
-extern s_move       root_list[];
+extern s_search     xb_search;
+extern s_hash       xb_hash;
 
 //values supplied by winboard
 extern int          xb_level_moves, xb_level_min, xb_level_inc;
@@ -48,18 +59,16 @@ extern int          xb_time, xb_otim, xb_st, xb_sd;
 extern bool         xb_post, xb_easy, xb_mode;
 
 //time control
-extern int          tc_moves, tc_target, tc_start;
+extern int          tc_moves;
 
 //hash keys
 extern U64          (*rnd_psq)[64], rnd_epc[], rnd_btm;
 
 
 extern char         err_msg[];
-extern s_hist       hist[];
 extern char         men_upper[], men_lower[];
 //search
-extern unsigned     nodes;
-extern int          abort_search, iter;
+extern int          num_cores, multi_pv;
 extern int          draw_score;
 
 //bitboard
@@ -80,40 +89,64 @@ extern int        (*directions)[64];
 extern U64        (*obstructed)[64];
 extern U64        (*ap_bish_rl45)[128], (*ap_bish_rr45)[128];
 extern U64        (*ap_rook_rl90)[128], (*ap_rook_rr00)[128];
+extern U64         *ap_magic;
+extern s_magic      mg_rook[], mg_bish[];
+extern const U64    magic_rook[], magic_bish[];
+extern U64          mask_rl45[], mask_rr45[];
 
 //====================================================================
 //fun prototypes
 //====================================================================
 void          Board(int black_side = 0);
 void          AddPiece(int c1, int b1);
-void          AgeHash(void);
+void          AgeHash(s_hash *ph);
 int           Attacked(int b1, int ka);
 U64           Attacks(int b2);
 int           CanWin();
-void          ClearHash(void);
+int           CountMov(int ply);
+void          ClearHash(s_hash *ph, int force = FALSE);
 bool          Draw3Rep(int ply, int first_rep);
-int           Eval();
-void          FreeHash();
+int           Eval(int ply);
+void          FreeHash(s_hash *ph);
+void          FreePerft();
 s_move      * GenCap(s_move *pm, int ply);
 s_move      * GenEvade(s_move *pm, int ply);
 s_move      * GenMov(s_move *pm, int ply);
 void          GenRoot(void);
+int           GivesCheck(int move, int ply);
 void          HashStore(int ply, int depth, int type, int threat, int val, int move);
 int           HashProbe(int ply, int &depth, int &type, int &threat, int &val, int &move);
+void          HashPrefetch(U64 key);
 void          InitAttack(void);
-int           InitHash(int hash_mb);
-int           Iterate(void);
+int           InitHash(s_hash *ph, int hash_mb);
+int           Iterate(s_search *ss);
+U64           KeyAfter(int move, int ply);
 int           Len(const char *pc);
+int           LoadHash(s_hash *ph, const char *name, int map);
+void          LoadPos(const s_pos *pos);
 int           MakeMove(int move);
 void          Move(int move, int ply);
+int           Mobility(int side, int ply);
 void          MoveNull(int ply);
+int           MoveValid(int move, int ply);
 const char  * Move2XBoard(int move);
 void          Play(void);
+U64           Perft(int depth, int ply);
+void          PerftRoot(int depth, int divide);
 void          Print(const char *fmt, ...);
 void          PVDisplay(int score, int mark);
+void          PVPrint(int score, int mark, const int *pv, int len);
 void          PVUpdate(int ply, int move);
+int           SaveHash(s_hash *ph, const char *name);
+void          SavePos(s_pos *pos);
+void          SearchGames(int games, int depth);
+void          SetCores(int n);
+void          SetSearchTime(s_search *ss);
+s_check     * SetCheck(int ply);
 bool          SetBoard(char *fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
-int           Sex(int move);
+int           See(int move);
+int           SeeGE(int move, int margin);
+unsigned      SmpNodes(void);
 void          ShutDown(int status);
 void          SortBubble(s_move *pm1, s_move *pm2, int num=0);
 void          SortReOrder(s_move *pm1, s_move *pm2);
@@ -123,3 +156,4 @@ void          UnMove(int move, int ply);
 void          UnMoveNull(int ply);
 void          UpdateHistory(int move, int ply, int depth);
 int           Val(const char *pc);
+void          WipeHash(s_hash *ph);
@@ -1,25 +1,69 @@
 //hash.cpp by Dan Honeycutt.  This software is public domain.
 //You may use this software as you wish.  There is no warranty.
+#include <thread>
 #include "chess.h"
 
 /*********************************************************************
 File contains functions to manage the transposition hash table.  The
-hash table is simply a large array of hash_entry structs.  Each entry
-has two values: the position key and the data.  The purpose of the 
-hash table is to save information that we gather during the search. 
-If the position arises again due to a transposition we can use the
-data to avoid having to research the position.
-
-The table is two part and works as follows:  Each key has two "slots". 
-Slot 1 has the "better" data.  New data is always wrtten to the table. 
-New data goes into slot 1 if it is empty or occupied by the current 
-position.  If slot 1 is occupied by a different position we determine 
-(based on depth) which data looks better.  If old data looks better 
-it stays in slot 1 and new data goes in slot 2.  If new data looks 
-better it goes in slot 1 and old data is moved to slot 2.
-
-To probe the table we first try slot 1.  If the position does not 
-match we then try slot2.
+purpose of the hash table is to save information that we gather 
+during the search.  If the position arises again due to a 
+transposition we can use the data to avoid having to research the
+position.
+
+The table is an array of 64 byte buckets, one cache line each, so a 
+probe costs at most one trip to memory.  A bucket holds hash_ways
+entries.  The low bits of the position key pick the bucket and the 
+high 32 bits are saved as a check so we know the entry is ours.  The
+checks are kept together at the front of the bucket so the data 
+stays 8 byte aligned:
+  hash_ways x 4 byte check | 4 byte epoch | hash_ways x 8 byte data
+
+To probe the table we look for our check in the bucket.  To store we
+use our own entry if we have one, else we throw out the entry that 
+looks least useful - the shallowest search, with entries left from 
+earlier searches counting as much shallower.
+
+Each entry is stamped with gen, the search generation.  AgeHash()
+bumps gen once per search instead of marking every entry old and
+a probe hit stamps the entry with the current generation so entries
+in use stay young.  
+
+Clearing the table for a new game or position would mean writing 
+every byte of it, which takes seconds on a big table.  Instead 
+ClearHash() bumps the epoch.  The epoch is xor'd into every check 
+so entries saved under an earlier epoch no longer match and are
+simply misses.  Each bucket records the epoch it was last written 
+under in its spare 4 bytes.  HashStore() wipes a bucket from an 
+earlier epoch before using it, so stale entries cannot hang on by 
+looking deep.  Only when the epoch counter wraps do we write the 
+whole table, and WipeHash() splits that job across threads.
+
+The table can be saved to a file and loaded back so a long analysis 
+is not lost when the program restarts (SaveHash() and LoadHash()). 
+Or a file can be mapped and used as the table itself, so the entries
+go to the file as they are stored and the next session picks them 
+up without copying.  The file is a hash_header, padded to hash_head 
+bytes so the buckets stay page aligned, followed by the buckets.  
+The header records the layout version and a signature of the random 
+numbers the keys are built from.  A file that was written with a 
+different layout or different keys would only give wrong scores, so
+it is rejected.  Loading a table and then setting up the position 
+to search would throw the table away, so a table loaded or mapped 
+from a file survives the next ClearHash() - once.  After that, or 
+once a search starts, the table is cleared as usual.  A clear for a 
+draw lurking (see Iterate()) is never skipped.
+
+A table and its epoch, generation and keep flag make up an s_hash 
+(see chess.h).  Each search context points to its own so games can 
+be searched at once from separate threads without one clearing or 
+aging the other's table.  The xboard loop's table is xb_hash.
+
+The table is shared by the search threads without locks.  Check and
+data are written as two separate stores so another thread can see 
+the check of one entry with the data of another.  To catch that the 
+check saved is the key check xor'd with both halves of the data.  A
+reader copies the data once and only accepts it if the check matches
+that copy, so a torn entry is simply a miss.
 
 Hash data is a bit field as follows:
   bits                  shift  mask      note
@@ -29,15 +73,13 @@ Hash data is a bit field as follows:
   17 - unsigned score   3      1ffff     score + 65536
   12 - depth            20     fff
   28 - move             32     fffffff   26 used by search
-   1 - old              60               
-   3 - unused           63
-
-Note:  simon does not use the threat field and the depth field is far
-larger than needed.  I took the hash routines from my program Bruja 
-and did not want to screw with them since hash bugs are easy to 
-introduce and hard as hell to find and fix.  The threat field will be 
-useful if you implement a null move and the larger depth field allows 
-fractional ply extensions.
+   4 - generation       60     f
+
+Note:  the threat field is set when a null move gets us mated, see 
+Search().  Depth is saved in PLY units for fractional ply extensions.
+I took the hash routines from my program Bruja and did not want to 
+screw with them since hash bugs are easy to introduce and hard as 
+hell to find and fix.
 **********************************************************************/
 
 //macros to insert and extract data
@@ -46,84 +88,149 @@ fractional ply extensions.
 #define hget_val(d)   (((int)  ((d)>>3) & 0x1ffff)-65536)
 #define hget_depth(d)  ((int) (((d)>>20) & 0xfff))
 #define hget_move(d)   ((int) (((d)>>32) & 0xfffffff))
+#define hget_gen(d)    ((int) (((d)>>60) & 0xf))
 
 #define hset_type(a)   (a)
 #define hset_threat(a) (((U64)  (a))<<2)
 #define hset_val(a)    (((U64) ((a)+65536))<<3)
 #define hset_depth(a)  (((U64)  (a))<<20)
 #define hset_move(a)   (((U64)  (a))<<32)
+#define hset_gen(a)    (((U64)  (a))<<60)
+
+#define hash_check(k)  ((unsigned) ((k)>>32))   //key check, high 32 bits
+//bucket index, low 32 bits of key scaled to n buckets (multiply-shift)
+#define hash_index(k, n) ((unsigned) (((U64) (unsigned) (k) * (n)) >> 32))
+#define hash_fold(d)   ((unsigned) (d) ^ (unsigned) ((d)>>32))
+
+static const int hash_ways = 5;             //entries per bucket
+static const U64 gen_mask = 0xf000000000000000;
+static const int age_weight = 8 * PLY;      //depth lost per generation
 
+typedef struct hash_bucket {
+  unsigned check[hash_ways];                //key check ^ hash_fold(data)
+  unsigned epoch;                           //ph->epoch when written
+  U64 data[hash_ways];
+} hash_bucket;
+
+//hash file header.  bump hash_version if the bucket layout, the data
+//fields or the way keys pick buckets and checks change.
 typedef struct {
-  U64 key1;
-  U64 data;
-} hash_entry;
-static hash_entry no_table[2];              //avoid invalid pointer
-static hash_entry * hash_table = no_table;  //hash table
-static unsigned int hash_nel = 0;           //number of elements
-static unsigned int hash_mask = 0;          //mask
-static const U64 old_entry = 0x1000000000000000;  //old entry flag
+  char magic[8];                            //hash_magic
+  unsigned version;                         //hash_version
+  unsigned bucket;                          //sizeof(hash_bucket)
+  unsigned ways;                            //hash_ways
+  unsigned nel;                             //number of buckets
+  unsigned epoch;                           //ph->epoch
+  unsigned gen;                             //ph->gen
+  U64 keys;                                 //KeySig()
+} hash_header;
+
+static const char hash_magic[8] = "simonTT";
+static const unsigned hash_version = 1;
+static const size_t hash_head = 4096;       //header + padding, bytes
 
 //====================================================================
 //InitHash() is called at program startup to allocate memory for the
-//hash table.  It also initializes our random number rnd_xxx 
-//variables which are used to build hash keys.  InitHash() is passed 
-//the desired table size in mb and returns the mb actually 
-//allocated.  Unfortunately with Windows (far as I know) the 
+//hash table of the xboard loop and again by the memory command to 
+//resize it.  Another search context gets its table the same way.  
+//InitHash() is passed the desired table size in mb and returns the 
+//mb actually allocated.  The table need not be a power of 2 in size:
+//hash_index() maps the key onto however many buckets fit so all the
+//mb asked for gets used.  The table is cleared, whatever it held is 
+//lost.  The new memory comes to us zeroed but we wipe it anyway so 
+//the pages are mapped in now by all threads rather than one at a 
+//time during the first search.
+//
+//Unfortunately with Windows (far as I know) the 
 //allocation never fails - if physical ram is not available it uses
 //virtual memory which will slow the program to a crawl.  If you 
 //know a way to have memory allocation fail if memory is not 
 //available please let me know.
 //====================================================================
-int InitHash(int hash_mb) {
-  extern U64 *rnd_num;
+int InitHash(s_hash *ph, int hash_mb) {
   const int min_mb = 2;   //minimum hash table size
-  int i,j;
-  //cast rnd_num[] to rnd_psq[16][64] and copy random numbers
-  //from (unused) row 0 to rnd_epc.  rnd_epc[0] stays 0 so it doesn't
-  //have to be hashed out when reset.
-  rnd_psq = (U64 (*)[64]) rnd_num;
-  for (i=1; i<48; i++) rnd_epc[i] = rnd_psq[0][i];
-  rnd_btm = rnd_psq[0][48];
-  //allocate largest valid mb value (power of 2) not greater than
-  //requested hash_mb
-  j = sizeof(hash_entry);
+  int j;
+  //release any table we have and allocate as many buckets as fit in
+  //the requested hash_mb
+  FreeHash(ph);
+  j = sizeof(hash_bucket);
   // Loop until we hit the break by passing the test
   for ( ; ; ) {
-    if (hash_mb < min_mb) {
-      hash_nel = 0;
-      hash_mask = 0;
-      hash_table = no_table;
-      break;
-    }
-    hash_nel = 65536;
-    while (hash_nel <= (unsigned) ((hash_mb * 524288) / j))
-      hash_nel = hash_nel << 1;
-    hash_mask = (hash_nel - 1)^1;
-    hash_table = (hash_entry*) malloc(hash_nel*j);
-    if (hash_table != NULL) break;
+    if (hash_mb < min_mb) break;
+    ph->nel = (unsigned) (((U64) hash_mb * 1048576) / j);
+    //page aligned so buckets start on a cache line
+    ph->bytes = (size_t) ph->nel * j;
+    ph->table = (hash_bucket*) BigAlloc(ph->bytes, TRUE);
+    if (ph->table != NULL) break;
     //allocation fails - reduce mb and try again
     hash_mb--;
   }
-  ClearHash();
-  hash_mb = (j * hash_nel)/1048576;
+  if (!ph->table) ph->nel = 0;
+  ph->epoch = 0;
+  WipeHash(ph);
+  ClearHash(ph);
+  hash_mb = (int) (((U64) j * ph->nel) / 1048576);
   return hash_mb;
 }
 
 //====================================================================
-//FreeHash() called at program termination to free hash memory
+//FreeHash() frees the memory of a table, at program termination or 
+//when it is replaced.
 //====================================================================
-void FreeHash() {
-  if (hash_table != no_table) free(hash_table);
+void FreeHash(s_hash *ph) {
+  if (ph->map) UnmapFile(ph->map, hash_head + ph->bytes);
+  else if (ph->table) BigFree(ph->table, ph->bytes);
+  ph->map = NULL;
+  ph->table = NULL;
+  ph->bytes = 0;
+  ph->nel = 0;
+  ph->keep = FALSE;
 }
 
 //====================================================================
-//ClearHash() clears the hash table, history heuristic & killers.
+//WipeHash() zeroes every bucket in the table.  The table is split 
+//into one slice per hardware thread and the slices are cleared at 
+//once.  Buckets are left with epoch 0.
 //====================================================================
-void ClearHash(void) {
-  unsigned i;
-  size_t bytes = hash_nel * sizeof(hash_entry);
-  if (bytes) memset(hash_table, 0, bytes);
+static void WipeSlice(hash_bucket *first, size_t count) {
+  memset(first, 0, count * sizeof(hash_bucket));
+}
 
+void WipeHash(s_hash *ph) {
+  std::thread pool[MAX_CORES];
+  size_t first, count, share;
+  int i, threads;
+
+  if (!ph->nel) return;
+  threads = (int) std::thread::hardware_concurrency();
+  if (threads > MAX_CORES) threads = MAX_CORES;
+  if (threads < 1) threads = 1;
+  share = (ph->nel + threads - 1) / threads;
+  for (i = 0, first = 0; first < ph->nel; i++, first += share) {
+    count = ph->nel - first;
+    if (count > share) count = share;
+    pool[i] = std::thread(WipeSlice, ph->table + first, count);
+  }
+  while (i--) pool[i].join();
+}
+
+//====================================================================
+//HashSyncHeader() copies the epoch and generation to the header of a
+//mapped file so the next session that maps it sees them.
+//====================================================================
+static void HashSyncHeader(s_hash *ph) {
+  hash_header *head = (hash_header *) ph->map;
+  if (!head) return;
+  head->epoch = ph->epoch;
+  head->gen = ph->gen;
+}
+
+//====================================================================
+//ClearHistory() clears the history heuristic & killers of the 
+//calling thread.
+//====================================================================
+void ClearHistory(void) {
+  unsigned i;
   //clear the history heuristic
   for (i = 0; i < 4096; i++) {
     hh_white[i] = hh_black[i] = 0;
@@ -137,14 +244,35 @@ void ClearHash(void) {
 }
 
 //====================================================================
-//AgeHash() "ages" the hash table.by setting all entrys to old.
+//ClearHash() clears the hash table, history heuristic & killers.
+//The table itself is cleared by starting a new epoch, see above, so
+//no memory is touched.  If the epoch wraps the table is wiped so a 
+//bucket from 4 billion clears ago can't pass for current.  A table 
+//just loaded from a file is spared the first clear unless force is 
+//TRUE.
+//====================================================================
+void ClearHash(s_hash *ph, int force) {
+  if (force || !ph->keep) {
+    if (++ph->epoch == 0) WipeHash(ph);
+    ph->gen = 0;
+    HashSyncHeader(ph);
+  }
+  ph->keep = FALSE;
+  ClearHistory();
+}
+
+//====================================================================
+//AgeHash() "ages" the hash table by starting a new generation.  
+//Entries from earlier generations are the first to be replaced.  
 //Also ages history heuristic and clears killers from the search 
 //tree.  The hash table is cleared on occasion unless a 50 move draw
 //is approaching, in which case it is cleared every move.
 //====================================================================
-void AgeHash(void) {
+void AgeHash(s_hash *ph) {
   unsigned i;
-  for (i=0; i < hash_nel; i++) hash_table[i].data |= old_entry;
+  ph->gen = (ph->gen + 1) & 15;
+  ph->keep = FALSE;         //a search is starting, table is in use
+  HashSyncHeader(ph);
   //age history
   for (i = 0; i < 4096; i++) {
     hh_white[i] = hh_white[i] >> 8;
@@ -160,65 +288,237 @@ void AgeHash(void) {
 
 //====================================================================
 //HashStore() and HashProbe() save and retrieve information from
-//the hash table
+//the hash table of the current search, srch->hash
 //====================================================================
 void HashStore(int ply, int depth, int type, int threat, int val, int move) {
-  //index slot
-  hash_entry *ph;
-  ph = hash_table + (key_1 & hash_mask);
+  s_hash *ph = srch->hash;
+  hash_bucket *pb;
+  unsigned check = hash_check(key_1) ^ ph->epoch;
+  int i, slot = 0, worth, least = INF;
+  U64 data;
   //adjust for mate
   if (val > DEAD) val += ply;
   else if (val < -DEAD) val -= ply;
 
-  if (ph->key1 != key_1) {
-    //slot 1 is empty or occupied by a different position
-    if ((ph->data & old_entry)||(depth >= hget_depth(ph->data))) {
-      //new data looks better.  get move from slot 2 if we have none
-      //and then move existing occupant (if any) to slot 2
-      if (!move && (ph + 1)->key1 == key_1) move = hget_move((ph+1)->data);
-      (ph+1)->key1 = ph->key1;
-      (ph+1)->data = ph->data;
-    } else {
-      //existing data in slot 1 looks better.  leave existing occupant
-      //alone and put new data in slot 2
-      ph++;
+  if (!ph->nel) return;
+  pb = ph->table + hash_index(key_1, ph->nel);
+  if (pb->epoch != ph->epoch) {
+    //left from before the last ClearHash() - empty it
+    memset(pb, 0, sizeof(hash_bucket));
+    pb->epoch = ph->epoch;
+  }
+  for (i = 0; i < hash_ways; i++) {
+    data = pb->data[i];
+    if ((pb->check[i] ^ hash_fold(data)) == check) {
+      //this is our entry.  save existing move if we have no new move
+      if (!move) move = hget_move(data);
+      slot = i;
+      break;
+    }
+    //else see if it's the least useful so far
+    worth = hget_depth(data) - age_weight * ((ph->gen - hget_gen(data)) & 15);
+    if (worth < least) {
+      least = worth;
+      slot = i;
     }
-  } else {
-    //this is our slot.  save existing move if we have no new move
-    if (!move) move = hget_move(ph->data);
   }
   if (depth < 0) depth = 0;   //don't try to store negative depth!
-  ph->key1 = key_1;
-  ph->data = hset_type(type) | hset_threat(threat) | hset_val(val) |
-    hset_depth(depth) | hset_move(move);
+  data = hset_type(type) | hset_threat(threat) | hset_val(val) |
+    hset_depth(depth) | hset_move(move) | hset_gen(ph->gen);
+  pb->data[slot] = data;
+  pb->check[slot] = check ^ hash_fold(data);
+}
+
+//====================================================================
+//HashPrefetch() starts loading the bucket for key into cache.  A 
+//probe of a big table nearly always misses cache so Search() calls 
+//this with the key of a child node (see KeyAfter()) before making 
+//the move, and the load overlaps with the work done until the child
+//probes.
+//====================================================================
+void HashPrefetch(U64 key) {
+  s_hash *ph = srch->hash;
+  Prefetch(ph->table + hash_index(key, ph->nel));
 }
 
 int HashProbe(int ply, int &depth, int &type, int &threat, int &val, int &move) {
-  hash_entry *ph;
-  ph = hash_table + (key_1 & hash_mask);
-  if (ph->key1 == key_1) {
-    move = hget_move(ph->data);
-    type = hget_type(ph->data);
-    threat = hget_threat(ph->data);
-    val = hget_val(ph->data);
-    if (val > DEAD) val -= ply;
-    else if (val < -DEAD) val += ply;
-    depth = hget_depth(ph->data);
-    ph->data &= ~old_entry;
-    return TRUE;
-  }
-  ph++;
-  if (ph->key1 == key_1) {
-    move = hget_move(ph->data);
-    type = hget_type(ph->data);
-    threat = hget_threat(ph->data);
-    val = hget_val(ph->data);
+  s_hash *ph = srch->hash;
+  hash_bucket *pb;
+  unsigned check = hash_check(key_1) ^ ph->epoch;
+  int i;
+  U64 data;
+  if (!ph->nel) return FALSE;
+  pb = ph->table + hash_index(key_1, ph->nel);
+  for (i = 0; i < hash_ways; i++) {
+    data = pb->data[i];
+    if ((pb->check[i] ^ hash_fold(data)) != check) continue;
+    move = hget_move(data);
+    type = hget_type(data);
+    threat = hget_threat(data);
+    val = hget_val(data);
     if (val > DEAD) val -= ply;
     else if (val < -DEAD) val += ply;
-    depth = hget_depth(ph->data);
-    ph->data &= ~old_entry;
+    depth = hget_depth(data);
+    //in use - make it current
+    if (hget_gen(data) != ph->gen) {
+      data = (data & ~gen_mask) | hset_gen(ph->gen);
+      pb->data[i] = data;
+      pb->check[i] = check ^ hash_fold(data);
+    }
     return TRUE;
   }
   return FALSE;
 }
 
+//====================================================================
+//KeySig() returns a signature of the random numbers hash keys are 
+//built from.  If they change every key in a saved table is wrong.
+//====================================================================
+static U64 KeySig(void) {
+  U64 sig = 0;
+  int i;
+  for (i = 0; i < 16 * 64; i++)
+    sig = ((sig << 7) | (sig >> 57)) ^ rnd_psq[i >> 6][i & 63];
+  return sig;
+}
+
+//====================================================================
+//SaveHash() writes the hash table to file name.  The table is 
+//written to name.tmp, flushed to disk and then renamed over name in 
+//one step, so if we die part way through an earlier save is not lost
+//and name never holds a partial table.  LoadHash() reads a table back
+//from a file, replacing the table we have with one the size of the 
+//file's.  If map is TRUE the file itself becomes the table instead,
+//see above.  A file to be mapped that does not exist is made from 
+//the table we have.  Saving a mapped table to its own file only 
+//flushes the mapping to disk.  Both return FALSE with the reason in 
+//err_msg if they fail.  The table we have is unchanged if LoadHash()
+//fails.
+//====================================================================
+int SaveHash(s_hash *ph, const char *name) {
+  static const char pad[hash_head] = {0};
+  char tmp[512];
+  hash_header head;
+  size_t bytes = (size_t) ph->nel * sizeof(hash_bucket);
+  FILE *pf;
+  int ok;
+
+  if (!ph->nel) {
+    strcpy(err_msg, "no hash table");
+    return FALSE;
+  }
+  if (ph->map && SameFile(name, ph->map_name)) {
+    //replacing the file would leave us mapped to a deleted file
+    HashSyncHeader(ph);
+    if (SyncFile(ph->map, hash_head + bytes)) return TRUE;
+    strcpy(err_msg, "can't write file");
+    return FALSE;
+  }
+  if (Len(name) + 5 > (int) sizeof(tmp)) {
+    strcpy(err_msg, "file name too long");
+    return FALSE;
+  }
+  memset(&head, 0, sizeof(head));
+  memcpy(head.magic, hash_magic, sizeof(head.magic));
+  head.version = hash_version;
+  head.bucket = sizeof(hash_bucket);
+  head.ways = hash_ways;
+  head.nel = ph->nel;
+  head.epoch = ph->epoch;
+  head.gen = ph->gen;
+  head.keys = KeySig();
+
+  sprintf(tmp, "%s.tmp", name);
+  pf = fopen(tmp, "wb");
+  if (!pf) {
+    strcpy(err_msg, "can't create file");
+    return FALSE;
+  }
+  ok = fwrite(&head, sizeof(head), 1, pf) == 1 &&
+    fwrite(pad, hash_head - sizeof(head), 1, pf) == 1 &&
+    fwrite(ph->table, 1, bytes, pf) == bytes && FlushFile(pf);
+  if (fclose(pf)) ok = FALSE;
+  if (!ok) {
+    remove(tmp);
+    strcpy(err_msg, "can't write file");
+    return FALSE;
+  }
+  if (!RenameFile(tmp, name)) {
+    remove(tmp);
+    strcpy(err_msg, "can't replace file");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+int LoadHash(s_hash *ph, const char *name, int map) {
+  hash_header head;
+  size_t bytes;
+  FILE *pf;
+  char *p;
+
+  if (map && Len(name) >= (int) sizeof(ph->map_name)) {
+    strcpy(err_msg, "file name too long");
+    return FALSE;
+  }
+  pf = fopen(name, "rb");
+  if (!pf && map) {
+    //a new file to map - start it with the table we have
+    if (!SaveHash(ph, name)) return FALSE;
+    pf = fopen(name, "rb");
+  }
+  if (!pf) {
+    strcpy(err_msg, "can't open file");
+    return FALSE;
+  }
+  if (fread(&head, sizeof(head), 1, pf) != 1 ||
+    memcmp(head.magic, hash_magic, sizeof(head.magic))) {
+    fclose(pf);
+    strcpy(err_msg, "not a hash file");
+    return FALSE;
+  }
+  if (head.version != hash_version || head.bucket != sizeof(hash_bucket) ||
+    head.ways != (unsigned) hash_ways || head.keys != KeySig() || 
+    !head.nel) {
+    fclose(pf);
+    strcpy(err_msg, "stale hash file");
+    return FALSE;
+  }
+  bytes = (size_t) head.nel * sizeof(hash_bucket);
+  if (map) {
+    fclose(pf);
+    //MapFile() checks the size, a damaged file is not padded out
+    p = (char *) MapFile(name, hash_head + bytes);
+    if (!p) {
+      strcpy(err_msg, "wrong file size or can't map file");
+      return FALSE;
+    }
+    FreeHash(ph);
+    ph->map = p;
+    strcpy(ph->map_name, name);
+    ph->table = (hash_bucket *) (p + hash_head);
+  } else {
+    p = (char *) BigAlloc(bytes, TRUE);
+    if (!p) {
+      fclose(pf);
+      strcpy(err_msg, "out of memory");
+      return FALSE;
+    }
+    if (fseek(pf, (long) hash_head, SEEK_SET) || 
+      fread(p, 1, bytes, pf) != bytes || fgetc(pf) != EOF) {
+      fclose(pf);
+      BigFree(p, bytes);
+      strcpy(err_msg, "wrong file size");
+      return FALSE;
+    }
+    fclose(pf);
+    FreeHash(ph);
+    ph->table = (hash_bucket *) p;
+  }
+  ph->bytes = bytes;
+  ph->nel = head.nel;
+  ph->epoch = head.epoch;
+  ph->gen = head.gen;
+  ph->keep = TRUE;
+  return TRUE;
+}
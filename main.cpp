@@ -26,51 +26,6 @@ void BitBoard(U64 num) {
   printf("\n  abcdefgh\n");
 }
 
-//====================================================================
-//Perft() is used to test the move generator.  It plays all moves and 
-//and replys to depth and counts them.  From the starting position 
-//a perft to depth 1 is 20 and to depth 2 is 400.
-//Call w/depth >= 1 and ply = 0.
-//====================================================================
-unsigned Perft(int depth, int ply) {
-  assert((depth > 0) && (ply < MAX_PLY));
-  s_move temp[256];
-  s_move *pm1 = temp, *pm2;
-  int move;
-  unsigned num=0;
-  if (incheck) 
-    pm2 = GenEvade(pm1, ply);
-  else 
-    pm2 = GenMov(GenCap(pm1, ply), ply);
-  if (depth == 1) return pm2-pm1;  //done
-  for (; pm1 < pm2; pm1++) {
-    move = pm1->move;
-    Move(move, ply);
-    num += Perft(depth-1, ply+1);
-    UnMove(move, ply);
-  }
-  return (num);
-}
-
-//====================================================================
-//TestGen() uses a well known position with all types of special 
-//moves as a torture test for the move generator.
-//====================================================================
-void TestGen() {
-  unsigned num, ans[6] = {0,48,2039,97862,4085603,193690690};
-  SetBoard("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 8");
-  Board();
-  for (int i = 1; i <= 5; i++) {
-    num = Perft(i, 0);
-    printf("Perft(%d)=%d   ans=%d   ", i, num, ans[i]);
-    if (num != ans[i]) {
-      Print("ERROR");
-      return;
-    }
-    Print("OK");
-  }
-}
-
 //====================================================================
 //64 bit random number generator for hash keys by Bruce Moreland.
 //====================================================================
@@ -80,9 +35,12 @@ U64 Rand64(void) {
 }
 
 //=====================================================================
-//InitMem() allocates the following global arrays from the free store.
-//These, plus the transposition hash table are the only memory that
-//simon allocates dynamically.
+//InitMem() allocates the following global arrays.  They are carved 
+//from one arena from BigAlloc() so the tables probed on every move 
+//sit together, cache line aligned.  The arena is under 1 mb but is 
+//rounded up to BIG_PAGE so it can be backed by one huge page, one 
+//TLB entry for all of them.  These, plus the transposition hash 
+//table are the only memory that simon allocates dynamically.
 //=====================================================================
 int (*directions)[64];            //directions from square to square
 U64 (*obstructed)[64];            //obstructed square mask
@@ -90,38 +48,76 @@ U64 (*ap_bish_rl45)[128];         //rotated bitboard attack boards
 U64 (*ap_bish_rr45)[128];
 U64 (*ap_rook_rl90)[128];
 U64 (*ap_rook_rr00)[128];
+U64 *ap_magic;                    //magic bitboard attack boards
+s_magic mg_rook[64];
+s_magic mg_bish[64];
 U64 *rnd_num;
 
+static char *arena = NULL;        //memory for all of the above
+static size_t arena_size = 0;
+
 void InitMem(void) {
-  directions = new int[64][64];
-  obstructed = new U64[64][64];
-  ap_bish_rl45 = new U64[64][128];
-  ap_bish_rr45 = new U64[64][128];
-  ap_rook_rl90 = new U64[64][128];
-  ap_rook_rr00 = new U64[64][128];
-if (bruja_book) {
+  char *pa;
+#if magic_bitboards
+  //sum over all squares of 2^(bits in mask): rook 102400, bishop 5248
+  const size_t magic_size = (102400 + 5248) * sizeof(U64);
+#else
+  const size_t rot_size = 64 * 128 * sizeof(U64);
+#endif
+  //every size is a multiple of 64 so each table is cache line aligned
+  arena_size = 64 * 64 * sizeof(int) + 64 * 64 * sizeof(U64) + 
+    1024 * sizeof(U64);
+#if magic_bitboards
+  arena_size += magic_size;
+#else
+  arena_size += 4 * rot_size;
+#endif
+  if (arena_size < BIG_PAGE) arena_size = BIG_PAGE;
+  arena = (char *) BigAlloc(arena_size);
+  if (arena == NULL) {
+    Print("Error (out of memory): tables");
+    exit(1);
+  }
+  pa = arena;
+  directions = (int (*)[64]) pa;
+  pa += 64 * 64 * sizeof(int);
+  obstructed = (U64 (*)[64]) pa;
+  pa += 64 * 64 * sizeof(U64);
+#if magic_bitboards
+  ap_magic = (U64 *) pa;
+  pa += magic_size;
+#else
+  ap_bish_rl45 = (U64 (*)[128]) pa;
+  pa += rot_size;
+  ap_bish_rr45 = (U64 (*)[128]) pa;
+  pa += rot_size;
+  ap_rook_rl90 = (U64 (*)[128]) pa;
+  pa += rot_size;
+  ap_rook_rr00 = (U64 (*)[128]) pa;
+  pa += rot_size;
+#endif
+  //hash keys are built from the fixed numbers in rand.cpp, not 
+  //Rand64(), so a position has the same key every run and a hash 
+  //table saved to a file (see SaveHash()) is good next time
   extern U64 random_numbers[];
-  rnd_num = random_numbers;
-}else{
-  rnd_num = new U64[1024];
-  for (int i = 0; i < 1024; i++) rnd_num[i] = Rand64();
-}
+  rnd_num = (U64 *) pa;
+  for (int i = 0; i < 1024; i++) rnd_num[i] = random_numbers[i];
+  //cast rnd_num[] to rnd_psq[16][64] and copy random numbers
+  //from (unused) row 0 to rnd_epc.  rnd_epc[0] stays 0 so it doesn't
+  //have to be hashed out when reset.
+  rnd_psq = (U64 (*)[64]) rnd_num;
+  for (int i = 1; i < 48; i++) rnd_epc[i] = rnd_psq[0][i];
+  rnd_btm = rnd_psq[0][48];
 } //InitMem()
 
 //=====================================================================
 //ShutDown() frees memory and terminates program.
 //=====================================================================
 void ShutDown(int status) {
-  delete[] directions;
-  delete[] obstructed;
-  delete[] ap_bish_rl45;
-  delete[] ap_bish_rr45;
-  delete[] ap_rook_rl90;
-  delete[] ap_rook_rr00;
-if (!bruja_book) {
-  delete[] rnd_num;
-}
-  FreeHash();
+  BigFree(arena, arena_size);
+  arena = NULL;
+  FreeHash(&xb_hash);
+  FreePerft();
   exit(status);
 } //ShutDown()
 
@@ -133,12 +129,17 @@ int CDECL
  main(int argc, char *argv[])  {  
   int i;
   int mb = 16;                      //default hash table size  
+  InitCPU();                        //check for popcnt etc.
   InitMem();                        //allocate memory for attack boards
   if (argc > 1) mb = Val(argv[1]);  //get hash from cmd line
   if (mb < 4) mb = 4;               //min if bad cmd line arg
-  mb = InitHash(mb);                //allocate hash memory
+  mb = InitHash(&xb_hash, mb);      //allocate hash memory
   
   for (i = 1; i < argc; i++) {
+  if (strcmp(argv[i], "-cores") == 0) {    //search threads
+    if (++i < argc) SetCores(Val(argv[i]));
+    continue;
+  }
   if (strcmp(argv[i], "-book") == 0) {
             bruja_book    = true;
             }else{
@@ -152,6 +153,7 @@ int CDECL
 }else{
   Print("internal book is off");
 }
+  if (num_cores > 1) Print("%d cores", num_cores);
   Print("%d mb hash\n",mb);
   Print("feature setboard=1 time=1");
   Print("feature variants=\"normal,nocastle\"");
@@ -239,6 +241,15 @@ available from Tim Mann's winboard site.
 #define CMD_PING      27
 #define CMD_ST        28
 #define CMD_HELP      29
+#define CMD_PERFT     30
+#define CMD_DIVIDE    31
+#define CMD_CORES     32
+#define CMD_MULTIPV   33
+#define CMD_MEMORY    34
+#define CMD_SAVEHASH  35
+#define CMD_LOADHASH  36
+#define CMD_MAPHASH   37
+#define CMD_GAMES     38
 
 static char const *cmds[] = {   //this list must match CMD_XXX
   "dummy",
@@ -271,6 +282,15 @@ static char const *cmds[] = {   //this list must match CMD_XXX
   "ping",
   "st",
   "help",
+  "perft",
+  "divide",
+  "cores",
+  "multipv",
+  "memory",
+  "savehash",
+  "loadhash",
+  "maphash",
+  "games",
   "variant nocastle",
   ".",
   "?",
@@ -417,7 +437,7 @@ void SendFeatures() {
   //feature done=0 winboard is going to wait for feature done=1
   //before it does anything.
   Print("feature ping=0 setboard=1 time=1 variants=normal,nocastle");
-  Print("feature sigint=0 sigterm=0 colors=0 analyze=1");
+  Print("feature sigint=0 sigterm=0 colors=0 analyze=1 smp=1 memory=1");
   Print("feature myname=\"%s\"", name);
   Print("feature done=1");
 }
@@ -462,7 +482,7 @@ void SendResult() {
 //====================================================================
 int Resign() {
   if (game_over) return 0;    //no need resign if game ended
-  if (root_score < -600) {  
+  if (xb_search.score < -600) {  
     //things look bad based on the score but we don't give up
     //unless we're down more than a rook in raw material
     if (kolor == WHITE) {
@@ -482,6 +502,7 @@ void Play(void) {
   int cmd, move, force = FALSE;
   int tm;
   int rm;
+  int mb;
 get_input:
   if (!xb_mode) {         //console mode - prompt for input
     if (game_over) printf("cmd: ");
@@ -579,6 +600,44 @@ get_input:
       if (UnMakeMove()) game_over = 0;
       else Print("Not enough history");
       goto get_input;
+    case CMD_PERFT:     //for debugging - not a winboard command
+      PerftRoot(Val(ibuf), FALSE);
+      goto get_input;
+    case CMD_DIVIDE:    //perft w/count for each root move
+      PerftRoot(Val(ibuf), TRUE);
+      goto get_input;
+    case CMD_CORES:     //number of search threads
+      SetCores(Val(ibuf));
+      goto get_input;
+    case CMD_MEMORY:    //resize the hash table, mb
+      mb = InitHash(&xb_hash, Val(ibuf));
+      if (mb) Print("%d mb hash", mb);
+      else Print("hash table disabled");
+      goto get_input;
+    case CMD_SAVEHASH:  //save the hash table to a file
+      ibuf[strcspn(ibuf, "\r\n")] = 0;
+      if (!SaveHash(&xb_hash, ibuf)) Print("Error (%s): savehash", err_msg);
+      goto get_input;
+    case CMD_LOADHASH:  //load the hash table from a file
+      ibuf[strcspn(ibuf, "\r\n")] = 0;
+      if (!LoadHash(&xb_hash, ibuf, FALSE)) Print("Error (%s): loadhash", err_msg);
+      goto get_input;
+    case CMD_MAPHASH:   //use a file as the hash table
+      ibuf[strcspn(ibuf, "\r\n")] = 0;
+      if (!LoadHash(&xb_hash, ibuf, TRUE)) Print("Error (%s): maphash", err_msg);
+      goto get_input;
+    case CMD_GAMES:     //for debugging - not a winboard command
+      {
+      int games = 2, depth = 8;
+      sscanf(ibuf, "%d %d", &games, &depth);
+      SearchGames(games, depth);
+      }
+      goto get_input;
+    case CMD_MULTIPV:   //number of best lines to post
+      multi_pv = Val(ibuf);
+      if (multi_pv < 1) multi_pv = 1;
+      if (multi_pv > MAX_MPV) multi_pv = MAX_MPV;
+      goto get_input;
     case CMD_HELP:      //our time remaining
 	  {
 	  size_t hind = 0;
@@ -613,7 +672,10 @@ if (bruja_book) {
   move = 0;
 }
   if (move) Print("0 0 0 0 (Book)");
-  else move = Iterate();
+  else {
+    SetSearchTime(&xb_search);
+    move = Iterate(&xb_search);
+  }
   
   
   if (!analysis_mode) {
@@ -15,9 +15,11 @@ void AddPiece(int c1, int b1) {
   board[b1] = c1;               //place on array board
   bbd[c1] |= bb_move;           //place on piece bitboard
   bbd[c1 & KTC] |= bb_move;     //place on all men bitboard
+#if !magic_bitboards
   bb_rl90 |= sq_set_rl90[b1];   //place on the 3 rotated boards
   bb_rl45 |= sq_set_rl45[b1];
   bb_rr45 |= sq_set_rr45[b1];
+#endif
   key_1 ^= rnd_psq[c1][b1];     //update hash key
   num_men[c1]++;                //update count of piece
   num_men[c1 & KTC] += piece_value[c1];   //total material (B & W)
@@ -43,9 +45,11 @@ void MovePiece(int c1, int b1, int b2) {
   board[b2] = c1;
   bbd[c1] ^= bb_move;
   bbd[c1 & KTC] ^= bb_move;
+#if !magic_bitboards
   bb_rl90 ^= sq_set_rl90[b1] | sq_set_rl90[b2];
   bb_rl45 ^= sq_set_rl45[b1] | sq_set_rl45[b2];
   bb_rr45 ^= sq_set_rr45[b1] | sq_set_rr45[b2];
+#endif
   key_1 ^= rnd_psq[c1][b1];
   key_1 ^= rnd_psq[c1][b2];
   if (c1 & SLIDE) {
@@ -66,9 +70,11 @@ void RemovePiece(int c1, int b2) {
   board[b2] = ESQ;
   bbd[c1] ^= bb_move;
   bbd[c1 & KTC] ^= bb_move;
+#if !magic_bitboards
   bb_rl90 ^= sq_set_rl90[b2];
   bb_rl45 ^= sq_set_rl45[b2];
   bb_rr45 ^= sq_set_rr45[b2];
+#endif
   key_1 ^= rnd_psq[c1][b2];
   num_men[c1]--;
   num_men[c1 & KTC] -= piece_value[c1];
@@ -85,9 +91,12 @@ void RemovePiece(int c1, int b2) {
   
 //====================================================================
 //Move() makes a move and updates position data.  It also updates
-//en passant square, castling status, game ply and hash keys.
+//en passant square, castling status, game ply and hash keys.  Move()
+//and UnMove() are templates on side, the color moving, so each color
+//gets its own copy with the color tests settled by the compiler.
 //====================================================================
-void Move(int move, int ply) {
+template <int side>
+static void Move(int move, int ply) {
   int b1, b2, man, cap, temp;
   castle[ply+1] = castle[ply];      //copy castling rights
   ep_sq[ply+1] = 0;                 //clear ep square
@@ -143,42 +152,101 @@ void Move(int move, int ply) {
     g_ply[ply+1] = 0;
     break;
   case 3:   //PxP ep
-    RemovePiece(cap, color ? b2+8 : b2-8);  //make capture
+    RemovePiece(cap, side ? b2+8 : b2-8);   //make capture
     cap = 0;
     break;
   case 4:   //Pawn promotion
     RemovePiece(man, b1);                   //remove pawn
-    man = mv_pro(move) + color;
+    man = mv_pro(move) + side;
     AddPiece(man, b1);                //replace w/promotion
     break;
   case 5:   //pawn 2 square advance
-    if (color) {
-      temp = b2+8;                            //square behind
-      if (ap_bpawn[temp] & bbd[WP]) {         //attack by enemy pawn
-        ep_sq[ply+1] = temp;                  //yes - set ep square
-        key_1 ^= rnd_epc[temp];
-      }
-    } else {
-      temp = b2-8;
-      if (ap_wpawn[temp] & bbd[BP]) {
-        ep_sq[ply+1] = temp;
-        key_1 ^= rnd_epc[temp];
-      }
+    temp = side ? b2+8 : b2-8;                //square behind
+    //attack by enemy pawn?
+    if ((side ? ap_bpawn[temp] : ap_wpawn[temp]) & bbd[PAWN + (side^KTC)]) {
+      ep_sq[ply+1] = temp;                    //yes - set ep square
+      key_1 ^= rnd_epc[temp];
     }
     break;
   } //switch spl
   if (cap) RemovePiece(cap, b2);        //remove cap if any
   MovePiece(man, b1, b2);               //make the move
-  color ^= KTC;                                 //toggle color to move
+  color = side ^ KTC;                           //toggle color to move
   key_1 ^= rnd_btm;
 }
 
+void Move(int move, int ply) {
+  if (color) Move<BLACK>(move, ply);
+  else Move<WHITE>(move, ply);
+}
+
+//====================================================================
+//KeyAfter() returns the hash key (key_1) of the position after move
+//without making the move.  The search uses it to prefetch the hash 
+//bucket of the child node, see HashPrefetch(), so the trip to memory
+//overlaps with making the move.  The key is exactly what Move() 
+//would leave in key_1.
+//====================================================================
+template <int side>
+static U64 KeyAfter(int move, int ply) {
+  int b1, b2, man, cap, cas, temp;
+  U64 key = key_1 ^ rnd_btm ^ rnd_epc[ep_sq[ply]];
+  man = mv_man(move);
+  b1 = mv_b1(move);
+  b2 = mv_b2(move);
+  cap = mv_cap(move);
+  //castling rights, as in Move()
+  if ((!(man & NO_CASTLE)) || ((cap & TYPE) == ROOK)) {
+    cas = castle[ply];
+    switch (man) {
+    case WK: cas &= 12; break;
+    case WR: if (b1 == A1) cas &= 13; else if (b1 == H1) cas &= 14; break;
+    case BK: cas &= 3; break;
+    case BR: if (b1 == A8) cas &= 7; else if (b1 == H8) cas &= 11; break;
+    }
+    switch (cap) {
+    case WR: if (b2 == A1) cas &= 13; else if (b2 == H1) cas &= 14; break;
+    case BR: if (b2 == A8) cas &= 7; else if (b2 == H8) cas &= 11; break;
+    }
+    key ^= rnd_epc[castle[ply]] ^ rnd_epc[cas];
+  }
+  key ^= rnd_psq[man][b1];
+  switch (mv_spl(move)) {
+  case 1:   //O-O
+    key ^= rnd_psq[ROOK + side][b1+3] ^ rnd_psq[ROOK + side][b1+1];
+    break;
+  case 2:   //O-O-O
+    key ^= rnd_psq[ROOK + side][b1-4] ^ rnd_psq[ROOK + side][b1-1];
+    break;
+  case 3:   //PxP ep
+    key ^= rnd_psq[cap][side ? b2+8 : b2-8];
+    cap = 0;
+    break;
+  case 4:   //Pawn promotion
+    man = mv_pro(move) + side;
+    break;
+  case 5:   //pawn 2 square advance
+    temp = side ? b2+8 : b2-8;
+    if ((side ? ap_bpawn[temp] : ap_wpawn[temp]) & bbd[PAWN + (side^KTC)])
+      key ^= rnd_epc[temp];
+    break;
+  }
+  if (cap) key ^= rnd_psq[cap][b2];
+  return key ^ rnd_psq[man][b2];
+}
+
+U64 KeyAfter(int move, int ply) {
+  if (color) return KeyAfter<BLACK>(move, ply);
+  return KeyAfter<WHITE>(move, ply);
+}
+
 //====================================================================
 //UnMove() reverses a move.  The inverse of Move()
 //====================================================================
-void UnMove(int move, int ply) {
+template <int side>
+static void UnMove(int move, int ply) {
   int b1, b2, man, cap;
-  color ^= KTC;                     //toggle color to move
+  color = side;                     //toggle color to move
   key_1 ^= rnd_btm;
   key_1 ^= rnd_epc[ep_sq[ply+1]];   //restore ep square
   key_1 ^= rnd_epc[ep_sq[ply]];
@@ -189,7 +257,7 @@ void UnMove(int move, int ply) {
   //check for king/rook move or rook capture
   if ((!(man & NO_CASTLE)) || ((cap & TYPE) == ROOK)) {
     if ((man & TYPE) == KING) {
-      if (man & BLACK) bk_sq = b1;
+      if (side) bk_sq = b1;
       else wk_sq = b1;
     }
     key_1 ^= rnd_epc[castle[ply]];
@@ -204,11 +272,11 @@ void UnMove(int move, int ply) {
     MovePiece(board[b1-1], b1-1, b1-4);
     break;
   case 3:   //PxP ep
-    AddPiece(cap, color ? b2+8 : b2-8);   //replace capture
+    AddPiece(cap, side ? b2+8 : b2-8);    //replace capture
     cap = 0;
     break;
   case 4:   //Pawn promotion
-    RemovePiece(mv_pro(move)+color, b2);  //remove piece
+    RemovePiece(mv_pro(move)+side, b2);   //remove piece
     AddPiece(man, b2);                    //replace w/pawn
     break;
   } //switch spl
@@ -216,9 +284,15 @@ void UnMove(int move, int ply) {
   if (cap) AddPiece(cap, b2);             //replace cap if any
 }
 
+void UnMove(int move, int ply) {
+  //color is the side to move after the move, not the one that made it
+  if (color) UnMove<WHITE>(move, ply);
+  else UnMove<BLACK>(move, ply);
+}
+
 //====================================================================
-//MoveNull() makes a null move.  simon does not employ a null move
-//but if you add one this will correctly make the null move
+//MoveNull() makes a null move, passing the move to the other side.
+//Used by the null move pruning in Search()
 //====================================================================
 void MoveNull(int ply) {
   castle[ply+1] = castle[ply];        //copy castling rights
@@ -263,7 +337,7 @@ int MakeMove(int move) {
   //check mate first - if the 50th move produces mate it's not a draw
   GenRoot();
   if (!root_moves) {
-    if (incheck) {
+    if (SetCheck(0)->checkers) {
       return (color ? FIN_BLACK_MATED : FIN_WHITE_MATED);
     } else {
       return FIN_STALEMATE;
@@ -0,0 +1,158 @@
+//perft.cpp by Dan Honeycutt.  This software is public domain.
+//You may use this software as you wish.  There is no warranty.
+#include <atomic>
+#include <thread>
+#include "chess.h"
+
+/*********************************************************************
+File contains Perft() which tests the move generator, and the perft 
+and divide commands which run it on the current position.  Perft 
+plays all moves and replys to depth and counts the positions at the 
+end.  Counts for many positions are well known so a wrong count 
+means a bug in the generators or in make/unmake.  Divide gives the 
+count for each root move which helps run the bug down by comparison
+with another program.
+
+To make deep perfts practical the root moves are split among threads,
+one per hardware thread whatever the cores command says, and subtree
+counts are saved in a hash table of their own.  An entry is stored 
+as key ^ data and data.  A thread that reads an entry while 
+another thread is writing it sees a key mismatch rather than a wrong 
+count.
+
+STL headers are included ahead of chess.h since chess.h defines
+macros (empty, occupied) which would trash them.
+*********************************************************************/
+
+typedef struct {
+  U64 check;      //key ^ data
+  U64 data;       //count << 8 | depth
+} perft_entry;
+
+static const unsigned perft_nel = 1 << 20;  //16 mb
+static perft_entry *perft_table = NULL;     //allocated on first use
+
+//====================================================================
+//Perft() is used to test the move generator.  It plays all moves and 
+//and replys to depth and counts them.  From the starting position 
+//a perft to depth 1 is 20 and to depth 2 is 400.  The last ply is
+//counted by CountMov() without making the moves.  Call w/depth >= 1.
+//====================================================================
+U64 Perft(int depth, int ply) {
+  assert((depth > 0) && (ply < MAX_PLY));
+  s_move temp[256];
+  s_move *pm1 = temp, *pm2;
+  perft_entry *ph = NULL;
+  int move;
+  U64 num = 0, data;
+  if (depth == 1) return CountMov(ply);   //done
+  if (perft_table) {
+    ph = perft_table + (key_1 & (perft_nel - 1));
+    data = ph->data;
+    if (((ph->check ^ data) == key_1) && ((int) (data & 255) == depth))
+      return data >> 8;
+  }
+  if (SetCheck(ply)->checkers) 
+    pm2 = GenEvade(pm1, ply);
+  else 
+    pm2 = GenMov(GenCap(pm1, ply), ply);
+  for (; pm1 < pm2; pm1++) {
+    move = pm1->move;
+    Move(move, ply);
+    num += Perft(depth-1, ply+1);
+    UnMove(move, ply);
+  }
+  if (ph) {
+    data = (num << 8) | depth;
+    ph->data = data;
+    ph->check = key_1 ^ data;
+  }
+  return (num);
+}
+
+//====================================================================
+//PerftThread() sets up its copy of the position and counts root 
+//moves until there are none left.  next is the next root move 
+//nobody has taken.
+//====================================================================
+static void PerftThread(const s_pos *pos, int depth, std::atomic<int> *next, U64 *count) {
+  int i, move;
+  LoadPos(pos);
+  for (i = (*next)++; i < root_moves; i = (*next)++) {
+    move = root_list[i].move;
+    if (depth == 1) {
+      count[i] = 1;
+      continue;
+    }
+    Move(move, 0);
+    count[i] = Perft(depth-1, 1);
+    UnMove(move, 0);
+  }
+}
+
+//====================================================================
+//PerftRoot() handles the perft and divide commands.  Runs a perft
+//to depth on the current position and reports the count, time and 
+//nodes per second.  If divide is TRUE we also report the count for 
+//each root move.
+//====================================================================
+void PerftRoot(int depth, int divide) {
+  std::thread pool[MAX_CORES];
+  std::atomic<int> next(0);
+  U64 count[256], total = 0;
+  s_pos pos;
+  int i, et, threads;
+
+  if ((depth < 1) || (depth > MAX_PLY)) {
+    Print("Error (depth 1 to %d): perft", MAX_PLY);
+    return;
+  }
+  if (!perft_table) {
+    perft_table = new perft_entry[perft_nel];
+    memset(perft_table, 0, perft_nel * sizeof(perft_entry));
+  }
+  threads = (int) std::thread::hardware_concurrency();
+  if (threads > MAX_CORES) threads = MAX_CORES;
+  if (threads > root_moves) threads = root_moves;
+  if (threads < 1) threads = 1;
+
+  SavePos(&pos);
+  et = Now();
+  for (i = 0; i < threads; i++)
+    pool[i] = std::thread(PerftThread, &pos, depth, &next, count);
+  for (i = 0; i < threads; i++) pool[i].join();
+  et = Now() - et;
+
+  for (i = 0; i < root_moves; i++) {
+    if (divide) Print("%s: %llu", Move2XBoard(root_list[i].move), count[i]);
+    total += count[i];
+  }
+  Print("perft %d: %llu nodes %d ms %llu nps", depth, total, et,
+    et ? total * 1000 / et : 0);
+}
+
+//====================================================================
+//FreePerft() called at program termination to free the perft table
+//====================================================================
+void FreePerft() {
+  delete[] perft_table;
+}
+
+//====================================================================
+//TestGen() uses a well known position with all types of special 
+//moves as a torture test for the move generator.
+//====================================================================
+void TestGen() {
+  U64 num, ans[6] = {0,48,2039,97862,4085603,193690690};
+  SetBoard("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 8");
+  Board();
+  for (int i = 1; i <= 5; i++) {
+    num = Perft(i, 0);
+    printf("Perft(%d)=%llu   ans=%llu   ", i, num, ans[i]);
+    if (num != ans[i]) {
+      Print("ERROR");
+      return;
+    }
+    Print("OK");
+  }
+}
@@ -1,46 +1,63 @@
 //search.cpp by Dan Honeycutt.  This software is public domain.
 //You may use this software as you wish.  There is no warranty.
+#include <thread>
 #include "chess.h"
 
+static thread_local int helper = FALSE;           //TRUE in smp helpers
+static thread_local int null_ply = 0;             //no null below this
+static thread_local int ext_max = 0;              //extension budget
+
+static const int futility_margin = 150;   //frontier futility pruning
+static const int razor_margin = 300;      //razoring
+static const int delta_margin = 200;      //qsearch delta pruning
+
 //====================================================================
-//SetSearchTime() sets our time allocation, tc_target
+//SetSearchTime() sets the time allocation and depth limit of a 
+//search from the winboard values, along with the thread count and 
+//number of lines from the cores and multipv commands.  The search 
+//uses the xboard loop's hash table and posts if xb_post is set.  
+//Other callers of Iterate() can set the fields of ss themselves.
 //====================================================================
-static void SetSearchTime() {
+void SetSearchTime(s_search *ss) {
   int total, avg, max;
-  tc_start = Now();
-  abort_search = FALSE;
+  ss->max_depth = xb_sd;
+  ss->cores = num_cores;
+  ss->multi_pv = multi_pv;
+  ss->hash = &xb_hash;
+  ss->post = xb_post;
   if (xb_st > 0) {                      //fixed sec/move
-    tc_target = xb_st * 1000 - 100;
+    ss->target = xb_st * 1000 - 100;
     return;
   }
   total = xb_level_min * 60000;         //total time, ms
   if (!xb_level_moves) {
     //incremental time control
-    tc_target = total / 100;            //plan for 100 moves
-    tc_target += 1000 * xb_level_inc;   //add increment if any
+    ss->target = total / 100;           //plan for 100 moves
+    ss->target += 1000 * xb_level_inc;  //add increment if any
   } else {
     //tournament time control
-    tc_target = avg = total / xb_level_moves;
+    ss->target = avg = total / xb_level_moves;
     if ((xb_time > 0) && (tc_moves > 0)) {
       //have time and moves remaining data
-      tc_target = xb_time * 10 / tc_moves;
+      ss->target = xb_time * 10 / tc_moves;
       max = xb_time / 2;
-      if (tc_target > avg) {
+      if (ss->target > avg) {
         //we have some time surplus
-        tc_target = 3 * tc_target / 2;
+        ss->target = 3 * ss->target / 2;
       }
-      if (tc_target > max) tc_target = max;
+      if (ss->target > max) ss->target = max;
     }
   }
 }
 
 //====================================================================
 //CheckClock() is called periodically by Search() to see if our
-//time is spent, in which case we set abort_search
+//time is spent, in which case we set srch->abort.  We never clear 
+//it here since Iterate() sets it to stop the helper threads.
 //====================================================================
 static void CheckSearchTime() {
-  int et = Now() - tc_start;     //time spent
-  abort_search = et > tc_target;
+  int et = Now() - srch->start;  //time spent
+  if (et > srch->target) srch->abort = TRUE;
 }
 
 //====================================================================
@@ -56,7 +73,7 @@ static bool IsDraw(int ply) {
     if (Draw3Rep(ply, (ply>1))) return TRUE;
     if (g_ply[ply] >= 100) {
       //draw unless the 50th move produces mate
-      if (incheck) {
+      if (SetCheck(ply)->checkers) {
         if (temp == GenEvade(temp, ply)) return FALSE;
       }
       return TRUE;
@@ -68,10 +85,12 @@ static bool IsDraw(int ply) {
 //====================================================================
 //QSearch() seeks to obtain a quiet position so our evaluation won't
 //be distorted by pending captures.  To do that it searches only
-//capture moves.
+//capture moves.  Captures that lose material are pruned and so are
+//captures that can't bring us back to alpha even winning the man 
+//taken with delta_margin to spare (delta pruning).
 //====================================================================
 int QSearch(int alpha, int beta, int ply) {
-  int stand_pat, val, best_val, move;
+  int stand_pat, val, best_val, move, in_check;
   s_move *pm, *pm1, *pm2;
 
   //housekeeping
@@ -80,13 +99,13 @@ int QSearch(int alpha, int beta, int ply) {
   if (ply >= MAX_PLY) return beta;
   if (!(nodes & 1023)) {  //check in every 1000 nodes
     CheckSearchTime();
-    if (abort_search) return 0;
+    if (srch->abort) return 0;
   }
 
   //stand_pat is the score we return if we find no worthwhile captures
   //if stand_pat is above beta we return right away - we can't kill
   //them any deader.
-  stand_pat = Eval();
+  stand_pat = Eval(ply);
   if (stand_pat > alpha) {
     if (stand_pat >= beta) return stand_pat;
     alpha = stand_pat;
@@ -94,9 +113,10 @@ int QSearch(int alpha, int beta, int ply) {
 
   //generate moves
   pm1 = tree[ply-1].pm2;
+  in_check = SetCheck(ply)->checkers != 0;
   
   if (!analysis_mode) {
-  if (incheck) {
+  if (in_check) {
     //in check
     pm2 = GenEvade(pm1, ply);
     if (pm2 == pm1) return -MATE + ply;   //checkmate
@@ -109,17 +129,19 @@ int QSearch(int alpha, int beta, int ply) {
 
 
 
-  //look for best capture and prune those that lose material
-  best_val = 0;
+  //prune captures that lose material or fall short of alpha and put 
+  //the most valuable victim taken by the least valuable attacker first
+  best_val = -INF;
   pm = pm1;
   while (pm < pm2) {
     move = pm->move;
-    val = Sex(move);
-    if (val < 0) {
+    if (!SeeGE(move, 0) || (!in_check && !mv_pro(move) &&
+      stand_pat + piece_value[mv_cap(move)] + delta_margin <= alpha)) {
       pm2--;
       *pm = *pm2;
       continue;
     }
+    val = 8 * piece_value[mv_cap(move)] - piece_value[mv_man(move)];
     if (val > best_val) {
       best_val = val;
       SortReOrder(pm1, pm);
@@ -134,7 +156,7 @@ int QSearch(int alpha, int beta, int ply) {
     Move(move, ply);
     val = -QSearch(-beta, -alpha, ply+1);
     UnMove(move, ply);
-    if (abort_search) return 0;
+    if (srch->abort) return 0;
     if (val > alpha) {
       if (val >= beta) {
         return val;
@@ -148,16 +170,162 @@ int QSearch(int alpha, int beta, int ply) {
 }
 
 //====================================================================
-//Search() performs the recursive alpha-beta search.  This is a very
-//basic search with no null move or extensions but it does utilize 
-//hash table, history heuristic and killers.  It also maintains the 
-//principal variation and handles draws and mate.
+//NextMove() is the move picker for Search().  Rather than generate
+//and score every move up front we hand out moves in stages and only 
+//generate a stage when the moves before it fail to produce a cutoff:
+//  1. the hash move (checked with MoveValid(), nothing generated)
+//  2. captures & queen promotions ordered by static exchange
+//  3. the two killers (also checked with MoveValid())
+//  4. non captures & under promotions ordered by history
+//moves handed out in stages 1 and 3 are skipped in stages 2 and 4.  
+//When in check Search() generates evasions (there are few of them) 
+//and NextMove() simply hands them out.  Returns 0 when out of moves.
+//====================================================================
+#define PICK_HASH       0
+#define PICK_GEN_CAP    1
+#define PICK_CAP        2
+#define PICK_KILLER1    3
+#define PICK_KILLER2    4
+#define PICK_GEN_MOV    5
+#define PICK_MOV        6
+#define PICK_EVADE      7
+#define PICK_DONE       8
+
+typedef struct {
+  int           stage;        //PICK_XXX
+  int           hash_move;    //hash move if played, else 0
+  s_move      * pm;           //next move in current stage
+  s_move      * pm2;          //end of moves in current stage
+} s_pick;
+
+static int NextMove(s_pick *pk, int ply) {
+  int move;
+  s_move *pm;
+  unsigned *hh;
+
+  switch (pk->stage) {
+  case PICK_HASH:
+    pk->stage = PICK_GEN_CAP;
+    if (pk->hash_move && MoveValid(pk->hash_move, ply)) return pk->hash_move;
+    pk->hash_move = 0;
+    //fall through
+  case PICK_GEN_CAP:
+    pk->pm = tree[ply-1].pm2;
+    pk->pm2 = tree[ply].pm2 = GenCap(pk->pm, ply);
+    for (pm = pk->pm; pm < pk->pm2; pm++) pm->val = See(pm->move);
+    SortBubble(pk->pm, pk->pm2);
+    pk->stage = PICK_CAP;
+    //fall through
+  case PICK_CAP:
+    while (pk->pm < pk->pm2) {
+      move = (pk->pm++)->move;
+      if (move != pk->hash_move) return move;
+    }
+    pk->stage = PICK_KILLER1;
+    //fall through
+  case PICK_KILLER1:
+    pk->stage = PICK_KILLER2;
+    move = tree[ply].killer1;
+    if (move && (move != pk->hash_move) && MoveValid(move, ply)) return move;
+    //fall through
+  case PICK_KILLER2:
+    pk->stage = PICK_GEN_MOV;
+    move = tree[ply].killer2;
+    if (move && (move != pk->hash_move) && MoveValid(move, ply)) return move;
+    //fall through
+  case PICK_GEN_MOV:
+    //non captures go after the captures
+    pk->pm = pk->pm2;
+    pk->pm2 = tree[ply].pm2 = GenMov(pk->pm, ply);
+    hh = color ? hh_black : hh_white;
+    for (pm = pk->pm; pm < pk->pm2; pm++) pm->val = hh[pm->move & 4095];
+    SortBubble(pk->pm, pk->pm2, 5);
+    pk->stage = PICK_MOV;
+    //fall through
+  case PICK_MOV:
+    while (pk->pm < pk->pm2) {
+      move = (pk->pm++)->move;
+      if ((move != pk->hash_move) && (move != tree[ply].killer1) &&
+        (move != tree[ply].killer2)) return move;
+    }
+    pk->stage = PICK_DONE;
+    break;
+  case PICK_EVADE:
+    if (pk->pm < pk->pm2) return (pk->pm++)->move;
+    pk->stage = PICK_DONE;
+    break;
+  }
+  return 0;
+}
+
+//====================================================================
+//SearchChild() searches the position after a move with depth plies
+//to go, dropping into QSearch() when the depth runs out.
+//====================================================================
+int Search(int alpha, int beta, int depth, int ply);
+
+static int SearchChild(int alpha, int beta, int depth, int ply) {
+  if (depth >= 0) return Search(alpha, beta, depth, ply);
+  return QSearch(alpha, beta, ply);
+}
+
+//====================================================================
+//Search() performs the recursive alpha-beta search.  It utilizes the
+//hash table, null move, late move reductions, extensions, history 
+//heuristic and killers.  It also maintains the principal variation
+//and handles draws and mate.  Depth is in PLY units so a move can 
+//be extended by a fraction of a ply.
+//
+//Principal variation search: we expect the first move to be best so
+//it alone gets the full window.  The rest get a zero window search 
+//that only proves them worse than alpha.  One that beats alpha is 
+//searched again with the full window.
+//
+//Late move reductions: quiet moves far down the list are unlikely to
+//be any good so they are searched a ply (two if very late) less.  
+//Moves with a good history score get a ply back.  We never reduce 
+//in check, extended moves, captures, promotions or killers.  A 
+//reduced move that beats alpha is searched again at full depth.
+//
+//Null move: if we can pass and a reduced search still fails high the
+//position is so good a real move will surely do as well.  We don't 
+//pass when in check, twice in a row or with only pawns left where 
+//zugzwang is the rule.  With one or two pieces zugzwang is still 
+//possible so a null move cutoff there is verified by a reduced 
+//search of this node without the null move.  If passing gets us 
+//mated we save that as a threat in the hash table and don't bother
+//with a null move the next time we get here.
+//
+//Internal iterative deepening: with no hash move to try first a deep
+//node is searched 2 plies shallower to find one, which the reduced 
+//search leaves in the hash table.  Worth it in the principal 
+//variation from 4 plies and elsewhere from 6.  Not done in check, 
+//there the evasions are few and ordered anyway.
+//
+//Futility pruning and razoring: at the frontier (depth under a ply,
+//the moves go straight to QSearch()) a quiet move can't raise a 
+//static eval futility_margin below alpha back to alpha, so once we 
+//have searched one move we skip those.  A ply further from the 
+//leaves with the eval razor_margin below alpha we ask QSearch() if 
+//captures can save us and give up if not.  Neither is done in check
+//or in the principal variation.
+//
+//Extensions: a check gets a ply (half if it loses material), a 
+//recapture or a pawn to the 7th half a ply.  The hash move gets a 
+//ply if it is singular - a reduced search of the other moves, with 
+//the hash move skipped, fails low against a margin below its hash 
+//score.  tree[ply].ext totals the extensions on the path and is kept
+//within ext_max so extensions can't blow up the search.
 //====================================================================
 int Search(int alpha, int beta, int depth, int ply) {
-  int val, move, best_move, h_type, h_depth;
-  int h_threat = 0;   //this will have use if you implement null move
-  s_move *pm, *pm1, *pm2;
-  unsigned hh_fact, *hh;
+  int val, move, best_move, h_type, h_depth, h_val, num;
+  int h_threat = 0;   //set if a null move gets us mated
+  int pieces, r, ext, save_ply, in_check, check, prev, singular;
+  int eval, futile;
+  const int skip = tree[ply].skip;    //move skipped by singular search
+  unsigned *hh;
+  s_move *pm;
+  s_pick pick;
 
   //housekeeping
   nodes++;
@@ -165,14 +333,18 @@ int Search(int alpha, int beta, int depth, int ply) {
   if (ply >= MAX_PLY) return beta;
   if (!(nodes & 1023)) {  //check in every 1000 nodes
     CheckSearchTime();
-    if (abort_search) return 0;
+    if (srch->abort) return 0;
   }
   tree[ply].key1 = key_1; //update search tree for draw detection
   if (IsDraw(ply) && !analysis_mode) return draw_score;
   
-  //see if we can get a quick cutoff from the hash table
+  //see if we can get a quick cutoff from the hash table.  not when 
+  //skipping a move, the hash score is for all the moves.
   best_move = 0;
-  if (HashProbe(ply, h_depth, h_type, h_threat, val, best_move)) {
+  h_type = HF_UPPER;
+  h_depth = h_val = 0;
+  if (!skip && HashProbe(ply, h_depth, h_type, h_threat, val, best_move)) {
+    h_val = val;
     if ((h_depth >= depth) || (val > DEAD && h_type != HF_UPPER)) {
       switch (h_type) {
       case HF_LOWER:
@@ -191,56 +363,149 @@ int Search(int alpha, int beta, int depth, int ply) {
     } //if enough depth
   } //if hash probe
 
-  //No hash cut but we may have a move to try.  We now generate moves
-  pm1 = tree[ply-1].pm2;
-  if (!analysis_mode) {
-  if (incheck) {
-    //in check
-    pm2 = GenEvade(pm1, ply);
-    if (pm2 == pm1) return -MATE + ply;   //checkmate
-  } else {
-    //not in check
-    pm2 = GenMov(GenCap(pm1, ply), ply);
-    if (pm2 == pm1) return draw_score;    //stalemate
+  //internal iterative deepening
+  if (!best_move && !skip && depth >= (beta-alpha > 1 ? 4*PLY : 6*PLY) &&
+    !SetCheck(ply)->checkers) {
+    Search(alpha, beta, depth - 2*PLY, ply);
+    if (srch->abort) return 0;
+    if (HashProbe(ply, h_depth, h_type, h_threat, val, best_move)) h_val = val;
   }
-}
 
-  //order moves.  note we don't do a complete sort, just
-  //the top handfull which is where cutoffs are most likely.
-  hh_fact = 3 * hh_max /2;  //score history moves 0 to 67
-  hh = color ? hh_black : hh_white;
-  for (pm = pm1; pm < pm2; pm++) {
-    move = pm->move;
-    if (mv_capro(move)) pm->val = Sex(move);
-    else {
-      if (move == tree[ply].killer1) pm->val = 80;
-      else if (move == tree[ply].killer2) pm->val = 70;
-      else pm->val = hh[move & 4095];
+  //No hash cut but we may have a move to try.  If we are in check
+  //we generate all the evasions and order them, otherwise NextMove() 
+  //generates moves a stage at a time.
+  pick.hash_move = best_move;
+  pick.stage = PICK_HASH;
+  tree[ply].pm2 = tree[ply-1].pm2;
+  in_check = SetCheck(ply)->checkers != 0;
+  if (in_check) {
+    pick.pm = tree[ply-1].pm2;
+    pick.pm2 = tree[ply].pm2 = GenEvade(pick.pm, ply);
+    if (pick.pm2 == pick.pm) return -MATE + ply;   //checkmate
+    for (pm = pick.pm; pm < pick.pm2; pm++) {
+      move = pm->move;
+      if (mv_capro(move)) pm->val = See(move);
+      else {
+        if (move == tree[ply].killer1) pm->val = 80;
+        else if (move == tree[ply].killer2) pm->val = 70;
+        else pm->val = (color ? hh_black : hh_white)[move & 4095];
+      }
+      //highest score See() can return is about 2 * q_val
+      if (move == best_move) pm->val = 3 * q_val;
+    }
+    SortBubble(pick.pm, pick.pm2, 5);
+    pick.stage = PICK_EVADE;
+  }
+  eval = in_check ? -INF : Eval(ply);
+  futile = FALSE;
+  if (!in_check && beta - alpha == 1 && alpha > -DEAD) {
+    //razoring
+    if (depth < 2*PLY && !best_move && !skip &&
+      eval + razor_margin <= alpha) {
+      val = QSearch(alpha, beta, ply);
+      if (srch->abort) return 0;
+      if (val <= alpha) return val;
+    }
+    //frontier futility
+    futile = depth < PLY && eval + futility_margin <= alpha;
+  }
+  if (!in_check && !skip) {
+    //null move
+    pieces = color ? b_pieces : w_pieces;
+    if (depth >= PLY && pieces && !h_threat && !tree[ply-1].null && 
+      ply >= null_ply && beta < DEAD && eval >= beta) {
+      r = depth > 6*PLY ? 3*PLY : 2*PLY;
+      tree[ply].null = TRUE;
+      tree[ply].move = 0;
+      tree[ply].ext = tree[ply-1].ext;
+      if (depth - PLY - r >= 0)   //child key, see MoveNull()
+        HashPrefetch(key_1 ^ rnd_btm ^ rnd_epc[ep_sq[ply]]);
+      MoveNull(ply);
+      val = -SearchChild(-beta, 1-beta, depth-PLY-r, ply+1);
+      UnMoveNull(ply);
+      tree[ply].null = FALSE;
+      if (srch->abort) return 0;
+      if (val >= beta) {
+        if (val > DEAD) val = beta;   //don't trust mate from a pass
+        if (pieces > 2) return val;
+        //few pieces, verify without a null move at this ply.  a full
+        //width search, so depth no less than 0
+        save_ply = null_ply;
+        null_ply = ply + 1;
+        val = Search(beta-1, beta, depth > r ? depth-r : 0, ply);
+        null_ply = save_ply;
+        if (srch->abort) return 0;
+        if (val >= beta) return val;
+      } else if (val < -DEAD) {
+        h_threat = TRUE;    //we're getting mated
+      }
     }
-    //highest score Sex() can return is about 2 * q_val
-    if (move == best_move) pm->val = 3 * q_val;
   }
-  SortBubble(pm1, pm2, 5);
+
+  //singular extension test for the hash move
+  singular = FALSE;
+  if (depth >= 6*PLY && best_move && !skip && h_type != HF_UPPER &&
+    h_depth >= depth - 3*PLY && abs_val(h_val) < DEAD) {
+    val = h_val - 50;
+    tree[ply].skip = best_move;
+    singular = Search(val-1, val, depth/2, ply) < val;
+    tree[ply].skip = 0;
+    if (srch->abort) return 0;
+  }
 
   //best move (if we find one) will go in the hash table
   best_move = 0;
 
-  //set end of our moves for next ply and search them
-  tree[ply].pm2 = pm2;
-  for (pm = pm1; pm < pm2; pm++) {
-    move = pm->move;
+  //search our moves
+  num = 0;
+  hh = color ? hh_black : hh_white;
+  prev = tree[ply-1].move;
+  while ((move = NextMove(&pick, ply))) {
+    if (move == skip) continue;
+    num++;
+    //the child probes the hash unless it is a qsearch.  start loading
+    //its bucket now
+    if (depth >= PLY) HashPrefetch(KeyAfter(move, ply));
+    //extensions
+    check = GivesCheck(move, ply);
+    ext = 0;
+    if (singular && move == pick.hash_move) ext = PLY;
+    else if (check) ext = SeeGE(move, 0) ? PLY : PLY/2;
+    else if (mv_cap(move) && mv_cap(prev) && mv_b2(move) == mv_b2(prev) &&
+      piece_value[mv_cap(move)] == piece_value[mv_cap(prev)]) ext = PLY/2;
+    else if (mv_type(move) == PAWN && row(mv_b2(move)) == (color ? 1 : 6))
+      ext = PLY/2;
+    if (ext > ext_max - tree[ply-1].ext) ext = ext_max - tree[ply-1].ext;
+    if (ext < 0) ext = 0;
+    //futility pruning
+    if (futile && num > 1 && !ext && !check && !mv_capro(move)) continue;
+    //late move reduction
+    r = 0;
+    if (num > 3 && depth >= 2*PLY && !in_check && !ext && !check &&
+      !mv_capro(move) && move != tree[ply].killer1 && 
+      move != tree[ply].killer2) {
+      r = (num > 8 && depth >= 4*PLY) ? 2*PLY : PLY;
+      if (hh[move & 4095] > hh_max / 2) r -= PLY;
+    }
+    tree[ply].move = move;
+    tree[ply].ext = tree[ply-1].ext + ext;
     Move(move, ply);
-    if (depth > 0)
-      val = -Search(-beta, -alpha, depth-1, ply+1);
-    else
-      val = -QSearch(-beta, -alpha, ply+1);
+    if (num == 1) {
+      val = -SearchChild(-beta, -alpha, depth-PLY+ext, ply+1);
+    } else {
+      val = -SearchChild(-alpha-1, -alpha, depth-PLY+ext-r, ply+1);
+      if (val > alpha && r)
+        val = -SearchChild(-alpha-1, -alpha, depth-PLY+ext, ply+1);
+      if (val > alpha && val < beta)
+        val = -SearchChild(-beta, -alpha, depth-PLY+ext, ply+1);
+    }
     UnMove(move, ply);
-    if (abort_search) return 0;
+    if (srch->abort) return 0;
     if (val > alpha) {  //see what sort of a score we got
       if (val >= beta) {
         //got a cutoff - save our hash and killer move
-        HashStore(ply, depth, HF_LOWER, h_threat, val, move);
-        UpdateHistory(move, ply, depth);
+        if (!skip) HashStore(ply, depth, HF_LOWER, h_threat, val, move);
+        UpdateHistory(move, ply, depth/PLY);
         return val;
       }
       PVUpdate(ply, move);
@@ -248,10 +513,12 @@ int Search(int alpha, int beta, int depth, int ply) {
       alpha = val;
     }
   }
+  if (!num) return skip ? alpha : draw_score;  //stalemate
+  if (skip) return alpha;
   //done searching moves.  update hash move and killers
   h_type = best_move ? HF_EXACT : HF_UPPER;
   HashStore(ply, depth, h_type, h_threat, alpha, best_move);
-  if (best_move) UpdateHistory(best_move, ply, depth);
+  if (best_move) UpdateHistory(best_move, ply, depth/PLY);
   return alpha;
 }
 
@@ -264,90 +531,363 @@ int SearchRoot(int alpha, int beta, int depth) {
   int val;
   const int ply = 0;
   int move;
+  unsigned n0, cnt;
   s_move *pm;
   s_move *pm1 = root_list;
   s_move *pm2 = pm1 + root_moves;
   pv_len[ply] = ply;
   tree[ply].key1 = key_1; //update search tree for draw detection
+  //a path can be extended by at most the root depth + 1 ply
+  ext_max = depth + PLY;
+  tree[ply].ext = 0;
 
   //set end of our moves for next ply and search them
   tree[ply].pm2 = move_list;
   for (pm = pm1; pm < pm2; pm++) {
     move = pm->move;
+    tree[ply].move = move;
+    n0 = nodes;
     Move(move, ply);
-    if (depth > 0)
-      val = -Search(-beta, -alpha, depth-1, ply+1);
-    else
-      val = -QSearch(-beta, -alpha, ply+1);
+    //principal variation search, see Search()
+    if (pm == pm1) {
+      val = -SearchChild(-beta, -alpha, depth-PLY, ply+1);
+    } else {
+      val = -SearchChild(-alpha-1, -alpha, depth-PLY, ply+1);
+      if (val > alpha && val < beta)
+        val = -SearchChild(-beta, -alpha, depth-PLY, ply+1);
+    }
     UnMove(move, ply);
-    if (abort_search) return 0;
+    //count the nodes for this move, see RootSort()
+    cnt = (unsigned) pm->val + (nodes - n0);
+    pm->val = cnt > 0x7fffffff ? 0x7fffffff : cnt;
+    if (srch->abort) return 0;
     if (val > alpha) {  //see what sort of a score we got
       //new best - put it at the head of the list
       SortReOrder(pm1, pm);
       PVUpdate(ply, move);
       if (val >= beta) return val;  //root fail hi, will have to repeat
-      PVDisplay(val, 0);
+      if (!helper) PVDisplay(val, 0);
       alpha = val;
     }
   }
   return alpha;
 }
 
+//====================================================================
+//RootSort() orders the root moves for the next iteration.  The best
+//move stays in front and the rest go by the nodes SearchRoot() 
+//counted for them in val: a move that took a big search to refute is
+//the most likely to become best.  The counts are then cleared for 
+//the next iteration.  Before that RootSort() returns the percent of 
+//the nodes that went to the best move, a measure of how settled it 
+//is which Iterate() uses to manage time.
+//====================================================================
+static int RootSort(void) {
+  s_move *pm;
+  U64 total = 0;
+  int share;
+  for (pm = root_list; pm < root_list + root_moves; pm++) total += pm->val;
+  share = total ? (int) (100 * (U64) root_list[0].val / total) : 0;
+  SortBubble(root_list + 1, root_list + root_moves);
+  for (pm = root_list; pm < root_list + root_moves; pm++) pm->val = 0;
+  return share;
+}
+
+//====================================================================
+//SearchRootMulti() is SearchRoot() for multi-pv.  Rather than just 
+//the best move it finds exact scores for the best num root moves, 
+//kept at the head of root_list in score order with their lines in 
+//mpv_pv[].  A move is searched with an open window until we have num
+//lines, after that with a zero window at the score of the last of 
+//them and again with a window open above if it beats that score.  
+//All moves share the hash table so that is much cheaper than num 
+//searches each excluding the moves found before.
+//====================================================================
+static thread_local int mpv_pv[MAX_MPV][MAX_PLY+2];   //line by rank
+static thread_local int mpv_len[MAX_MPV];
+
+static int SearchRootMulti(int depth, int num) {
+  const int ply = 0;
+  int i, j, k, n, val, move, alpha;
+  s_move *pm, temp;
+  s_move *pm1 = root_list;
+  s_move *pm2 = pm1 + root_moves;
+  if (num > root_moves) num = root_moves;
+  pv_len[ply] = ply;
+  tree[ply].key1 = key_1; //update search tree for draw detection
+  ext_max = depth + PLY;
+  tree[ply].ext = 0;
+
+  tree[ply].pm2 = move_list;
+  n = 0;                  //lines found so far
+  for (pm = pm1; pm < pm2; pm++) {
+    move = pm->move;
+    alpha = n < num ? -INF : pm1[num-1].val;
+    tree[ply].move = move;
+    Move(move, ply);
+    if (alpha == -INF) {
+      val = -SearchChild(-INF, INF, depth-PLY, ply+1);
+    } else {
+      val = -SearchChild(-alpha-1, -alpha, depth-PLY, ply+1);
+      if (val > alpha) val = -SearchChild(-INF, -alpha, depth-PLY, ply+1);
+    }
+    UnMove(move, ply);
+    if (srch->abort) return 0;
+    if (val <= alpha) continue;
+    //one of the best, find its rank and move it there
+    if (n < num) n++;
+    for (k = n-1; k > 0 && pm1[k-1].val < val; k--) ;
+    temp = *pm;
+    temp.val = val;
+    for (i = pm - pm1; i > k; i--) pm1[i] = pm1[i-1];
+    pm1[k] = temp;
+    for (i = n-1; i > k; i--) {
+      mpv_len[i] = mpv_len[i-1];
+      for (j = 0; j < mpv_len[i]; j++) mpv_pv[i][j] = mpv_pv[i-1][j];
+    }
+    mpv_pv[k][0] = move;
+    mpv_len[k] = pv_len[ply+1] > 1 ? pv_len[ply+1] : 1;
+    for (j = 1; j < mpv_len[k]; j++) mpv_pv[k][j] = pv_move[ply+1][j];
+    if (k == 0) PVUpdate(ply, move);
+  }
+  return pm1[0].val;
+}
+
+//====================================================================
+//Lazy SMP.  With more than one core Iterate() starts ss->cores - 1 
+//helper threads.  Each loads its own copy of the position (position
+//and search variables are thread_local) and runs its own iterative
+//deepening with an open window.  The only things the threads share 
+//are the search context and the hash table, which is the point: what
+//the helpers find there speeds the main thread, which alone picks the
+//move.  Odd numbered helpers start a ply deeper so the threads don't
+//all work on the same depth.  When the main thread is done it sets 
+//ss->abort and waits for them.
+//====================================================================
+static void HelperThread(s_search *ss, const s_pos *pos, int id) {
+  int i, depth;
+  helper = TRUE;
+  srch = ss;
+  LoadPos(pos);
+  nodes = 0;
+  for (i = 0; i < root_moves; i++) root_list[i].val = 0;
+  for (depth = 1 + (id & 1); depth <= ss->max_depth; depth++) {
+    SearchRoot(-INF, INF, (depth-1) * PLY);
+    ss->helper_nodes[id] = nodes;
+    if (ss->abort) break;
+    RootSort();
+  }
+  ss->helper_nodes[id] = nodes;
+}
+
+//====================================================================
+//SmpNodes() returns the nodes searched by the helpers of the current
+//search so far.  Each reports at the end of an iteration.
+//====================================================================
+unsigned SmpNodes(void) {
+  int i;
+  unsigned sum = 0;
+  for (i = 1; i < srch->cores; i++) sum += srch->helper_nodes[i];
+  return sum;
+}
+
+//====================================================================
+//SetCores() sets the number of search threads, the cores command.
+//====================================================================
+void SetCores(int n) {
+  if (n < 1) n = 1;
+  if (n > MAX_CORES) n = MAX_CORES;
+  num_cores = n;
+}
+
 //====================================================================
 //Iterate() performs iterative deepening.  It calls Search() with 
 //increasing depth until our time is spent.  After each iteration we
-//set a window of +/- 1/2 pawn around the score returned.  The 
-//narrowed values of alpha and beta produce more cutoffs.  We expect 
-//the next iteration score to be inside the window but that may not 
-//be the case if the search discovers something that significantly
-//changes the score.  If that happens we open the window on the side
-//that failed and repeat the search.  We resist the temptation to 
-//close the window on the other side which, due to search instability,
-//could cause a never ending iteration.
+//set a window around the score returned.  The narrowed values of 
+//alpha and beta produce more cutoffs.  The window is delta wide each
+//side, a base of 35 plus the average swing of the score from one 
+//iteration to the next, so it is narrow while the score is steady.
+//We expect the next iteration score to be inside the window but 
+//that may not be the case if the search discovers something that 
+//significantly changes the score.  If that happens we double delta,
+//widen the window on the side that failed and repeat the search, 
+//and open that side all the way once delta passes 400.  We resist 
+//the temptation to close the window on the other side which, due to
+//search instability, could cause a never ending iteration.  Fail 
+//lows and highs are counted in ss.
+//
+//The search runs on the position of the calling thread with the 
+//time target, depth limit, thread count, lines and hash table set in
+//ss (see SetSearchTime()).  Several games can be searched at once, 
+//each from its own thread with its own ss and table, see 
+//SearchGames().
 //====================================================================
-int Iterate() {
-  int val;
+int Iterate(s_search *ss) {
+  int i, val;
   int alpha = -INF;
   int beta = INF;
+  int delta = 0;            //aspiration window, each side
+  int swing = 0;            //4 x average score change per iteration
+  std::thread pool[MAX_CORES];
+  s_pos pos;
 
-  SetSearchTime();  //set time target
+  srch = ss;
+  ss->start = Now();
+  ss->abort = FALSE;
+  if (ss->cores < 1) ss->cores = 1;
+  if (ss->cores > MAX_CORES) ss->cores = MAX_CORES;
   if (Draw3Rep(0, TRUE) || (g_ply[0] > 90)) {
-    ClearHash();    //clear hash if a draw is lurking
+    ClearHash(ss->hash, TRUE);  //clear hash if a draw is lurking
   } else {
-    AgeHash();      //otherwise age
+    AgeHash(ss->hash);          //otherwise age
   }
-  root_score = 0;
+  ss->score = 0;
+  ss->best_share = 0;
+  ss->fail_lo = ss->fail_hi = 0;
   nodes = 0;
+  for (i = 0; i < root_moves; i++) root_list[i].val = 0;
+
+  //start the helpers
+  SavePos(&pos);
+  for (i = 1; i < ss->cores; i++) {
+    ss->helper_nodes[i] = 0;
+    pool[i] = std::thread(HelperThread, ss, &pos, i);
+  }
 
   //iterate till our time is spent
-  iter = 1;
+  ss->iter = 1;
   // Loop until one of the break conditions is met
   for ( ; ; ) {
-    val = SearchRoot(alpha, beta, iter-1);
-    if (abort_search) break;
+    if (ss->multi_pv > 1 && root_moves > 1) {
+      //multi-pv, no aspiration window.  post the lines best first
+      val = SearchRootMulti((ss->iter-1) * PLY, ss->multi_pv);
+      if (ss->abort) break;
+      for (i = 0; i < ss->multi_pv && i < root_moves; i++)
+        PVPrint(root_list[i].val, 0, mpv_pv[i], mpv_len[i]);
+      ss->score = val;
+      if (Now() - ss->start >  ss->target/2) break;
+      ss->iter++;
+      if (ss->iter > ss->max_depth) break;
+      continue;
+    }
+    val = SearchRoot(alpha, beta, (ss->iter-1) * PLY);
+    if (ss->abort) break;
     //see if we got a value inside the window
     if (val <= alpha) {
-      alpha = -INF;
+      ss->fail_lo++;
+      delta += delta;
+      alpha = (delta > 400 || val < -DEAD) ? -INF : val - delta;
       PVDisplay(val, -1);
       continue;             //root fail lo
     }
     if (val >= beta) {
-      beta = INF;
+      ss->fail_hi++;
+      delta += delta;
+      beta = (delta > 400 || val > DEAD) ? INF : val + delta;
       PVDisplay(val, +1);
       continue;             //root fail hi
     }
     //iteration complete, set aspiration window for next iteration
-    alpha = val - 50;
-    beta = val + 50;
-    root_score = val;
-    //if 1/2 our time spent we probably can't complete the iteration
-    if (Now() - tc_start >  tc_target/2) break;
-    iter++;
-    if (iter > xb_sd) break;
+    if (ss->iter > 1) {
+      i = abs_val(val - ss->score);
+      swing += (i > 400 ? 400 : i) - swing / 4;
+    }
+    delta = 35 + swing / 4;
+    if (abs_val(val) > DEAD) {
+      alpha = -INF;         //no window on mate scores
+      beta = INF;
+    } else {
+      alpha = val - delta;
+      beta = val + delta;
+    }
+    ss->score = val;
+    ss->best_share = RootSort();
+    //if 1/2 our time spent we probably can't complete the iteration.
+    //if the best move took 90% of the effort it's settled, save time.
+    if (Now() - ss->start > 
+      (ss->best_share >= 90 ? ss->target/3 : ss->target/2)) break;
+    ss->iter++;
+    if (ss->iter > ss->max_depth) break;
     if (val > DEAD) break;
   }
+  //stop the helpers
+  ss->abort = TRUE;
+  for (i = 1; i < ss->cores; i++) pool[i].join();
   return root_list[0].move;
 }
 
+//====================================================================
+//SearchGames() handles the games command, a check that searches of
+//separate games don't disturb each other.  The current position is 
+//searched to depth alone and then as that many games at once, each 
+//from its own thread with its own search context and hash table.  
+//Every game must find the same move and score in the same number of
+//nodes as the lone search.
+//====================================================================
+typedef struct {
+  s_search  ss;
+  s_hash    hash;
+  int       mb;               //hash mb allocated
+  int       move;             //move found
+  unsigned  nodes;            //nodes searched
+} s_game;
+
+static void GameThread(s_game *pg, const s_pos *pos) {
+  pg->mb = InitHash(&pg->hash, 8);
+  LoadPos(pos);
+  pg->move = Iterate(&pg->ss);
+  pg->nodes = nodes;
+}
+
+void SearchGames(int games, int depth) {
+  std::thread pool[MAX_CORES+1];
+  s_game *pg;
+  s_pos pos;
+  int i, et, bad = 0;
+
+  if ((games < 1) || (games > MAX_CORES)) {
+    Print("Error (games 1 to %d): games", MAX_CORES);
+    return;
+  }
+  if ((depth < 1) || (depth > MAX_PLY)) {
+    Print("Error (depth 1 to %d): games", MAX_PLY);
+    return;
+  }
+  if (!root_moves) {
+    Print("Error (no moves): games");
+    return;
+  }
+  pg = new s_game[games+1]();
+  for (i = 0; i <= games; i++) {
+    pg[i].ss.hash = &pg[i].hash;
+    pg[i].ss.target = 1 << 30;          //no time limit
+    pg[i].ss.max_depth = depth;
+    pg[i].ss.cores = 1;
+    pg[i].ss.multi_pv = 1;
+    pg[i].ss.post = FALSE;
+  }
+  SavePos(&pos);
+  //game 0 alone, then the rest at once
+  pool[0] = std::thread(GameThread, &pg[0], &pos);
+  pool[0].join();
+  et = Now();
+  for (i = 1; i <= games; i++)
+    pool[i] = std::thread(GameThread, &pg[i], &pos);
+  for (i = 1; i <= games; i++) pool[i].join();
+  et = Now() - et;
+
+  for (i = 0; i <= games; i++) {
+    Print("game %d: %s score %d nodes %u", i, Move2XBoard(pg[i].move),
+      pg[i].ss.score, pg[i].nodes);
+    if (!pg[i].mb || (pg[i].move != pg[0].move) || 
+      (pg[i].ss.score != pg[0].ss.score) || (pg[i].nodes != pg[0].nodes))
+      bad++;
+    FreeHash(&pg[i].hash);
+  }
+  delete[] pg;
+  if (bad) Print("Error (%d games differ): games", bad);
+  else Print("games %d depth %d: OK %d ms", games, depth, et);
+}
+
 
 
@@ -288,7 +288,9 @@ static void BBInit() {
     bbd[b1] = 0;
     num_men[b1] = 0;
   }
+#if !magic_bitboards
   bb_rl90 = bb_rl45 = bb_rr45 = 0;
+#endif
   key_1 = key_2 = 0;
   for (b1 = 0; b1 < 64; b1++) {
     if ((c1 = board[b1])) {
@@ -345,10 +347,39 @@ bool SetBoard(char *fen) {
     return FALSE;
   }
   //looks OK.  Clear hash and history
-  root_score = 0;
+  xb_search.score = 0;
   game_over = 0;
-  ClearHash();
+  ClearHash(&xb_hash);
 
   return TRUE;
 }
 
+//====================================================================
+//SavePos() and LoadPos() copy the basic position (at ply 0) and the
+//game history so it can be set up in another thread.  LoadPos() 
+//rebuilds the bitboards and hash keys and generates that thread's 
+//root moves.
+//====================================================================
+void SavePos(s_pos *pos) {
+  int b1;
+  for (b1 = 0; b1 < 64; b1++) pos->board[b1] = board[b1];
+  pos->color = color;
+  pos->cast = castle[0];
+  pos->ep = ep_sq[0];
+  pos->gp = g_ply[0];
+  pos->hix = hix;
+  for (b1 = 0; b1 <= hix; b1++) pos->hist[b1] = hist[b1];
+}
+
+void LoadPos(const s_pos *pos) {
+  int b1;
+  for (b1 = 0; b1 < 64; b1++) board[b1] = pos->board[b1];
+  color = pos->color;
+  castle[0] = pos->cast;
+  ep_sq[0] = pos->ep;
+  g_ply[0] = pos->gp;
+  hix = pos->hix;
+  for (b1 = 0; b1 <= hix; b1++) hist[b1] = pos->hist[b1];
+  BBInit();
+  GenRoot();
+}
@@ -12,9 +12,17 @@ straighten out whtever doesn't work yourself
 #ifdef WIN32
   typedef unsigned __int64 U64;   //bitboard data type
   #include <windows.h>
+  #include <io.h>
 #else
   typedef unsigned long long U64;
   #include <sys/time.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #ifdef __linux__
+    #include <sys/syscall.h>
+  #endif
 #endif
 
 //=====================================================================
@@ -30,6 +38,198 @@ __inline int Now() {
 #endif
 }
 
+//=====================================================================
+//BigAlloc() and BigFree() allocate and free large blocks of memory,
+//the hash table and the table arena made by InitMem().  The memory 
+//comes straight from the system, page aligned and zeroed, rather 
+//than from the heap.  Blocks of 2 mb or more are backed by huge 
+//pages where the system allows: explicit huge pages if any are 
+//reserved (Linux hugetlbfs, Windows large pages which need the lock
+//pages in memory privilege), else transparent huge pages.  A huge 
+//page maps what takes 512 normal pages so random hash probes miss 
+//the TLB far less.  If interleave is TRUE, as it is for the hash 
+//table, on Linux the pages are spread across the memory nodes we may
+//use so on a multi-socket machine no one node serves all the search
+//threads.  Otherwise a page goes on the node of the thread that 
+//first touches it.  BigFree() must be passed the size that was 
+//passed to BigAlloc().  BigAlloc() returns NULL on failure.
+//=====================================================================
+#define BIG_PAGE 2097152          //huge page size
+
+__inline size_t BigSize(size_t bytes) {
+  if (bytes < BIG_PAGE) return bytes;
+  return (bytes + BIG_PAGE - 1) & ~(size_t) (BIG_PAGE - 1);
+}
+
+__inline void *BigAlloc(size_t bytes, int interleave = 0) {
+  void *p;
+  size_t size = BigSize(bytes);
+#ifdef WIN32
+  SIZE_T large = GetLargePageMinimum();
+  if (large && bytes >= large) {
+    p = VirtualAlloc(NULL, (size + large - 1) & ~(large - 1),
+      MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if (p) return p;
+  }
+  return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (bytes >= BIG_PAGE) p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (p == MAP_FAILED) {
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, 
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+    if (bytes >= BIG_PAGE) madvise(p, size, MADV_HUGEPAGE);
+#endif
+  }
+#if defined(SYS_mbind) && defined(SYS_get_mempolicy)
+  //MPOL_INTERLEAVE (3) over the nodes get_mempolicy() with 
+  //MPOL_F_MEMS_ALLOWED (4) says we are allowed.  pages are placed 
+  //when first touched.  skipped without NUMA.
+  if (interleave) {
+    unsigned long nodes[16] = {0};
+    if (!syscall(SYS_get_mempolicy, NULL, nodes, 8 * sizeof(nodes), NULL, 4))
+      syscall(SYS_mbind, p, size, 3, nodes, 8 * sizeof(nodes), 0);
+  }
+#endif
+  return p;
+#endif
+}
+
+__inline void BigFree(void *p, size_t bytes) {
+  if (!p) return;
+#ifdef WIN32
+  VirtualFree(p, 0, MEM_RELEASE);
+#else
+  munmap(p, BigSize(bytes));
+#endif
+}
+
+//=====================================================================
+//MapFile() maps the existing file name into memory, read/write and 
+//shared, so what is written to the memory ends up in the file.  The 
+//file must be exactly bytes long, it is never resized.  SyncFile() 
+//writes what has changed in a mapped file out to disk.  UnmapFile()
+//must be passed the size that was passed to MapFile().  MapFile() 
+//returns NULL on failure.  SameFile() returns TRUE if names a and b
+//are the same existing file.
+//=====================================================================
+__inline void *MapFile(const char *name, size_t bytes) {
+  void *p;
+#ifdef WIN32
+  HANDLE file, map;
+  LARGE_INTEGER size;
+  file = CreateFileA(name, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+    NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) return NULL;
+  if (!GetFileSizeEx(file, &size) || (U64) size.QuadPart != bytes) {
+    CloseHandle(file);
+    return NULL;
+  }
+  map = CreateFileMappingA(file, NULL, PAGE_READWRITE, 0, 0, NULL);
+  CloseHandle(file);
+  if (!map) return NULL;
+  p = MapViewOfFile(map, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+  CloseHandle(map);
+  return p;
+#else
+  struct stat st;
+  int fd = open(name, O_RDWR);
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) || (U64) st.st_size != bytes) {
+    close(fd);
+    return NULL;
+  }
+  p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  return p == MAP_FAILED ? NULL : p;
+#endif
+}
+
+__inline int SyncFile(void *p, size_t bytes) {
+#ifdef WIN32
+  return FlushViewOfFile(p, bytes) != 0;
+#else
+  return msync(p, bytes, MS_SYNC) == 0;
+#endif
+}
+
+__inline void UnmapFile(void *p, size_t bytes) {
+  if (!p) return;
+#ifdef WIN32
+  UnmapViewOfFile(p);
+#else
+  munmap(p, bytes);
+#endif
+}
+
+__inline int SameFile(const char *a, const char *b) {
+#ifdef WIN32
+  BY_HANDLE_FILE_INFORMATION ia, ib;
+  HANDLE fa, fb;
+  int same = 0;
+  fa = CreateFileA(a, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | 
+    FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  fb = CreateFileA(b, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | 
+    FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (fa != INVALID_HANDLE_VALUE && fb != INVALID_HANDLE_VALUE &&
+    GetFileInformationByHandle(fa, &ia) && 
+    GetFileInformationByHandle(fb, &ib)) {
+    same = ia.dwVolumeSerialNumber == ib.dwVolumeSerialNumber &&
+      ia.nFileIndexHigh == ib.nFileIndexHigh &&
+      ia.nFileIndexLow == ib.nFileIndexLow;
+  }
+  if (fa != INVALID_HANDLE_VALUE) CloseHandle(fa);
+  if (fb != INVALID_HANDLE_VALUE) CloseHandle(fb);
+  return same;
+#else
+  struct stat sa, sb;
+  if (stat(a, &sa) || stat(b, &sb)) return 0;
+  return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+#endif
+}
+
+//=====================================================================
+//FlushFile() pushes what has been written to open file pf all the 
+//way out to disk so it survives a crash.  RenameFile() renames file 
+//from to to, replacing any file to in one step: whoever opens to 
+//finds the old file or the new one, never neither.  Both return TRUE
+//if OK.
+//=====================================================================
+__inline int FlushFile(FILE *pf) {
+  if (fflush(pf)) return 0;
+#ifdef WIN32
+  return _commit(_fileno(pf)) == 0;
+#else
+  return fsync(fileno(pf)) == 0;
+#endif
+}
+
+__inline int RenameFile(const char *from, const char *to) {
+#ifdef WIN32
+  return MoveFileExA(from, to, 
+    MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  return rename(from, to) == 0;
+#endif
+}
+
+//=====================================================================
+//Prefetch() asks the cpu to start loading the cache line holding p.
+//It returns at once and the load goes on in the background.
+//=====================================================================
+__inline void Prefetch(const void *p) {
+#ifdef WIN32
+  PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, p);
+#else
+  __builtin_prefetch(p);
+#endif
+}
+
 //====================================================================
 //FirstBit(), LastBit(), and BitCount() locate and count bits in a 64
 //bit (bitboard) value.  for example the classic center squares for
@@ -40,13 +240,53 @@ __inline int Now() {
 //   h8                                  d4 a4      a3      a2      a1
 //sq 63                                  27 24      16      8       0
 //FirstBit(402653184) returns 27 (square d4), LastBit(402653184)
-//returns 28 (square e4) and BitCount(402653184) returns 2.
+//returns 28 (square e4) and BitCount(402653184) returns 2.  the 
+//result of FirstBit() and LastBit() is undefined if val is 0.
 
-//BitCount() uses the fact that x & (x - 1) clears the low bit in
-//x.  It simply resets 1 bit at a time and counts them till gone
+//every 64 bit x86 cpu has bsf and bsr so FirstBit() and LastBit()
+//compile to a single instruction (tzcnt and lzcnt if the compiler 
+//is told the cpu has bmi).  popcnt is newer.  unless the compiler is
+//told it can use popcnt (-mpopcnt or -march=native) BitCount() checks
+//cpu_popcnt, set at startup by InitCPU(), and falls back to a
+//software count on old cpus.
 //====================================================================
+extern int cpu_popcnt;    //cpu has popcnt instruction
 
-#ifdef WIN32
+#if defined(_MSC_VER) && defined(_M_X64)
+
+#include <intrin.h>
+
+__forceinline int FirstBit(U64 val) {
+  unsigned long b;
+  _BitScanForward64(&b, val);
+  return (int) b;
+}
+
+__forceinline int LastBit(U64 val) {
+  unsigned long b;
+  _BitScanReverse64(&b, val);
+  return (int) b;
+}
+
+__forceinline int BitCount(U64 val) {
+  if (cpu_popcnt) return (int) __popcnt64(val);
+  val = val - ((val >> 1) & 0x5555555555555555);
+  val = (val & 0x3333333333333333) + ((val >> 2) & 0x3333333333333333);
+  val = (val + (val >> 4)) & 0x0f0f0f0f0f0f0f0f;
+  return (int) ((val * 0x0101010101010101) >> 56);
+}
+
+__inline void InitCPU() {
+  int info[4];
+  __cpuid(info, 1);
+  cpu_popcnt = (info[2] >> 23) & 1;
+}
+
+#elif defined(WIN32)
+
+//32 bit msvc.  BitCount() uses the fact that x & (x - 1) clears the 
+//low bit in x.  It simply resets 1 bit at a time and counts them 
+//till gone
 
 //keep compiler from barking about no return value
 #pragma warning(disable : 4035)
@@ -95,16 +335,72 @@ done:
 }
 #pragma warning(default : 4035)
 
-#else   //ifdef WIN32
+__inline void InitCPU() {}
+
+#elif defined(__GNUC__)
+
+__inline int FirstBit(U64 val) {
+  return __builtin_ctzll(val);
+}
+
+__inline int LastBit(U64 val) {
+  return 63 ^ __builtin_clzll(val);
+}
+
+#if defined(__POPCNT__) || !(defined(__x86_64__) || defined(__i386__))
+
+//compiler knows it can use popcnt (or the cpu is not x86 and the 
+//builtin is the best choice anyhow)
+__inline int BitCount(U64 val) {
+  return __builtin_popcountll(val);
+}
+
+__inline void InitCPU() {}
+
+#else
+
+static __attribute__((target("popcnt"))) inline int BitCountHW(U64 val) {
+  return __builtin_popcountll(val);
+}
+
+__inline int BitCount(U64 val) {
+  if (cpu_popcnt) return BitCountHW(val);
+  val = val - ((val >> 1) & 0x5555555555555555ULL);
+  val = (val & 0x3333333333333333ULL) + ((val >> 2) & 0x3333333333333333ULL);
+  val = (val + (val >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int) ((val * 0x0101010101010101ULL) >> 56);
+}
+
+__inline void InitCPU() {
+  __builtin_cpu_init();
+  cpu_popcnt = __builtin_cpu_supports("popcnt");
+}
+
+#endif  //if __POPCNT__
+
+//with bmi2 the magic multiply in atk_rook() and atk_bish() can be 
+//replaced by pext which gathers the occupancy bits directly.  pext 
+//is microcoded (slow) on amd cpus before zen 3 so build with
+//-Dno_pext for those.
+#if defined(__BMI2__) && !defined(no_pext)
+  #include <immintrin.h>
+  #define use_pext 1
+#endif
+
+#else   //no compiler support
 
 //====================================================================
-//non assembly versions.  BitCount() is OK but the C versions First/
-//LastBit() is too slow.  to simon FirstBit() and LastBit() are the 
-//same so there is only one function for both.  To find things like
-//the most advanced or backward pawn you will need the functionality
-//of both.
+//non assembly versions.  FirstBit() isolates the low bit and looks
+//it up with a de Bruijn multiply.  LastBit() is a binary search.
 //====================================================================
-#define FirstBit LastBit
+__inline int FirstBit(U64 val) {
+  static const int index64[64] = {
+     0,  1, 48,  2, 57, 49, 28,  3, 61, 58, 50, 42, 38, 29, 17,  4,
+    62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12,  5,
+    63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+    46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19,  9, 13,  8,  7,  6};
+  return index64[((val & (0 - val)) * 0x03f79d71b4cb0a89ULL) >> 58];
+}
 
 __inline int LastBit(U64 val) {
   int i1, b2 = 0;
@@ -117,12 +413,19 @@ __inline int LastBit(U64 val) {
   return (b2);
 }
 
-__inline int BitCount(U64 b) {
-  int i;
-  for (i = 0; b; i++, b &= (b - 1));
-  return i;
+__inline int BitCount(U64 val) {
+  val = val - ((val >> 1) & 0x5555555555555555ULL);
+  val = (val & 0x3333333333333333ULL) + ((val >> 2) & 0x3333333333333333ULL);
+  val = (val + (val >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int) ((val * 0x0101010101010101ULL) >> 56);
 }
 
-#endif  //ifdef WIN32
+__inline void InitCPU() {}
+
+#endif  //compiler
+
+#ifndef use_pext
+  #define use_pext 0
+#endif
 
 #endif  //ifndef SYSTEM_H
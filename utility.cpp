@@ -98,15 +98,24 @@ int MateIn(int val) {
 //a companion 1-dimensional array keeps track of the length.
 //====================================================================
 void PVDisplay(int score, int mark) {
-  int val, j;
+  PVPrint(score, mark, pv_move[0], pv_len[0]);
+}
+
+//====================================================================
+//PVPrint() posts one line, pv[0] to pv[len-1], with its score.  A
+//mark of +1/-1 flags a root fail high/low.  PVDisplay() posts the 
+//principal variation, multi-pv lines are posted from Iterate().
+//====================================================================
+void PVPrint(int score, int mark, const int *pv, int len) {
+  int j;
   char rm[10];
 
-  if (!xb_post) return;
+  if (!srch->post) return;
   // Time is reported to the nearest centisecond:
-  int et = (int)((Now() - tc_start + 5)/10);
+  int et = (int)((Now() - srch->start + 5)/10);
 
   //format the root move
-  strcpy(rm, Move2XBoard(pv_move[0][0]));
+  strcpy(rm, Move2XBoard(pv[0]));
   j = Len(rm);
   if (mark) {
     if (mark > 0) rm[j] = '!';
@@ -122,16 +131,16 @@ void PVDisplay(int score, int mark) {
     if (score > 0) score += 32767-MATE;
     else score -= 32767-MATE;
   }
-  printf("%d %d %ld %ld %s", iter, score, et, nodes, rm);
+  printf("%d %d %ld %ld %s", srch->iter, score, et, nodes + SmpNodes(), rm);
   
   
   
-  for (j=1; j<pv_len[0]; j++) {
-    printf(" %s", Move2XBoard(pv_move[0][j]));
+  for (j=1; j<len; j++) {
+    printf(" %s", Move2XBoard(pv[j]));
   }
   printf("\n");    //send \n & flush buffer
   fflush(stdout);
-} //PVDisplay();
+} //PVPrint();
 
 void PVUpdate(int ply, int move) {
   int j;
@@ -240,7 +249,7 @@ void Board(int black_side) {
 //Move2XBoard() returns winboard from-to-promotion format string
 //==================================================================
 const char *Move2XBoard(int move) {
-  static char buf[6];
+  static thread_local char buf[6];
   char *pc = buf;
   *pc++ = (char) ('a' + col(mv_b1(move)));
   *pc++ = (char) ('1' + row(mv_b1(move)));